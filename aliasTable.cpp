@@ -0,0 +1,42 @@
+#include "aliasTable.h"
+#include <vector>
+
+void BuildAliasTable(const float *weights, int count, AliasEntry *table)
+{
+    if (count <= 0) return;
+
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        if (weights[i] > 0) total += weights[i];
+    }
+    if (total <= 0) {
+        for (int i = 0; i < count; i++) table[i] = AliasEntry{0.0f, 0};
+        table[0].probability = 1.0f;
+        return;
+    }
+
+    // Scaled so the average column holds exactly 1
+    std::vector<double> scaled(count);
+    std::vector<int> small, large;
+    for (int i = 0; i < count; i++) {
+        scaled[i] = weights[i] > 0 ? weights[i] * count / total : 0.0;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    // Top up each underfull column from an overfull one, which may become underfull in turn
+    while (!small.empty() && !large.empty()) {
+        int less = small.back();
+        small.pop_back();
+        int more = large.back();
+        table[less] = AliasEntry{static_cast<float>(scaled[less]), static_cast<uint32_t>(more)};
+        scaled[more] -= 1.0 - scaled[less];
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // What's left is full up to rounding error
+    for (int i : large) table[i] = AliasEntry{1.0f, static_cast<uint32_t>(i)};
+    for (int i : small) table[i] = AliasEntry{1.0f, static_cast<uint32_t>(i)};
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+// Vose's alias method: picks one of count weighted outcomes with one table lookup.
+// Column i of the table returns i with the given probability and alias otherwise; every column is
+// equally likely, so a pick is one uniform column plus one biased coin, however many outcomes there are.
+struct AliasEntry
+{
+    float probability = 1.0f; // Chance of keeping the column's own outcome
+    uint32_t alias = 0;       // Outcome returned otherwise
+};
+
+// Fills table[0..count) from weights[0..count). Zero (or negative) weights are never picked;
+// if no weight is positive, outcome 0 always is.
+void BuildAliasTable(const float *weights, int count, AliasEntry *table);
+
+// Outcome for two independent uniform 32-bit numbers
+inline int SampleAliasTable(const AliasEntry *table, int count, uint32_t columnBits, uint32_t coinBits)
+{
+    int column = static_cast<int>((static_cast<uint64_t>(columnBits) * static_cast<uint32_t>(count)) >> 32);
+    float coin = (coinBits >> 8) * (1.0f / 16777216.0f); // 24 bits, exact in a float, in [0, 1)
+    return coin < table[column].probability ? column : static_cast<int>(table[column].alias);
+}
@@ -0,0 +1,148 @@
+#include "atlas.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+Atlas::Atlas(int pageWidth, int maxPageHeight) : pageWidth(pageWidth), maxPageHeight(maxPageHeight) {}
+
+void Atlas::Clear() {
+    pages.clear();
+    usedPixels = 0;
+}
+
+AtlasRegion Atlas::Allocate(int w, int h) {
+    AtlasRegion region;
+    if (w <= 0 || h <= 0) return region;
+
+    int x = 0, y = 0;
+    int pageIndex = -1;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (Place(pages[i], w, h, x, y)) {
+            pageIndex = static_cast<int>(i);
+            break;
+        }
+    }
+    if (pageIndex < 0) {
+        // New page, wide enough for images that don't fit the default width
+        Page page;
+        page.width = std::max(pageWidth, w);
+        page.skyline.push_back({ 0, 0, page.width });
+        pages.push_back(std::move(page));
+        pageIndex = static_cast<int>(pages.size()) - 1;
+        Place(pages.back(), w, h, x, y);
+    }
+
+    // Grow the page down to fit; fixed width means existing rows stay put
+    Page &page = pages[pageIndex];
+    if (y + h > page.height) {
+        page.height = y + h;
+        page.pixels.resize(static_cast<size_t>(page.width) * page.height, 0);
+    }
+
+    usedPixels += static_cast<size_t>(w) * h;
+    region.page = pageIndex;
+    region.x = x;
+    region.y = y;
+    region.width = w;
+    region.height = h;
+    return region;
+}
+
+AtlasRegion Atlas::Add(const ImageView &image) {
+    AtlasRegion region = Allocate(image.width, image.height);
+    if (region.page < 0) return region;
+
+    uint32_t *dst = GetPixels(region);
+    int dstStride = pages[region.page].width;
+    for (int row = 0; row < image.height; row++) {
+        std::memcpy(dst + static_cast<size_t>(row) * dstStride, image.pixels + static_cast<size_t>(row) * image.stride,
+                    image.width * sizeof(uint32_t));
+    }
+    return region;
+}
+
+uint32_t *Atlas::GetPixels(const AtlasRegion &region) {
+    if (region.page < 0) return nullptr;
+    Page &page = pages[region.page];
+    return page.pixels.data() + static_cast<size_t>(region.y) * page.width + region.x;
+}
+
+ImageView Atlas::GetView(const AtlasRegion &region) const {
+    ImageView view;
+    if (region.page < 0) return view;
+    const Page &page = pages[region.page];
+    view.pixels = page.pixels.data() + static_cast<size_t>(region.y) * page.width + region.x;
+    view.width = region.width;
+    view.height = region.height;
+    view.stride = page.width;
+    return view;
+}
+
+size_t Atlas::GetBytes() const {
+    size_t bytes = 0;
+    for (const auto &page : pages) {
+        bytes += page.pixels.size() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+size_t Atlas::GetUsedBytes() const {
+    return usedPixels * sizeof(uint32_t);
+}
+
+float Atlas::GetOccupancy() const {
+    size_t total = GetBytes();
+    return total ? static_cast<float>(GetUsedBytes()) / total : 1.0f;
+}
+
+bool Atlas::Place(Page &page, int w, int h, int &outX, int &outY) {
+    auto &skyline = page.skyline;
+    int bestIndex = -1;
+    int bestY = INT_MAX, bestWidth = INT_MAX;
+
+    // Bottom-left: lowest resting position, ties go to the narrowest segment
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int x = skyline[i].x;
+        if (x + w > page.width) break;
+
+        int y = 0;
+        int remaining = w;
+        for (size_t j = i; remaining > 0; j++) {
+            y = std::max(y, skyline[j].y);
+            remaining -= skyline[j].width;
+        }
+        if (y + h > maxPageHeight && !(page.height == 0 && y == 0)) continue;
+
+        if (y < bestY || (y == bestY && skyline[i].width < bestWidth)) {
+            bestIndex = static_cast<int>(i);
+            bestY = y;
+            bestWidth = skyline[i].width;
+        }
+    }
+    if (bestIndex < 0) return false;
+
+    outX = skyline[bestIndex].x;
+    outY = bestY;
+
+    // Raise the skyline under the new image, trimming the segments it covers
+    skyline.insert(skyline.begin() + bestIndex, { outX, outY + h, w });
+    for (size_t i = bestIndex + 1; i < skyline.size();) {
+        int prevRight = skyline[i - 1].x + skyline[i - 1].width;
+        if (skyline[i].x >= prevRight) break;
+        int shrink = prevRight - skyline[i].x;
+        skyline[i].x += shrink;
+        skyline[i].width -= shrink;
+        if (skyline[i].width > 0) break;
+        skyline.erase(skyline.begin() + i);
+    }
+    // Merge neighbours at the same height
+    for (size_t i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+    return true;
+}
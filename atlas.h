@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "image.h"
+
+// Where an image lives inside an Atlas
+struct AtlasRegion
+{
+    int page = -1;
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+};
+
+// Packs many small images into a few contiguous pages with a skyline (bottom-left) packer.
+// Pages have a fixed width and grow downwards as images are added, so rows never move
+// and a page is only as tall as its content.
+class Atlas
+{
+public:
+    explicit Atlas(int pageWidth = 1024, int maxPageHeight = 2048);
+
+    void Clear();
+
+    // Reserves space for a w x h image, pixels start out transparent
+    AtlasRegion Allocate(int w, int h);
+    AtlasRegion Add(const ImageView &image); // Allocate + copy
+
+    uint32_t *GetPixels(const AtlasRegion &region);
+    ImageView GetView(const AtlasRegion &region) const;
+
+    int GetPageCount() const { return static_cast<int>(pages.size()); }
+    size_t GetBytes() const;        // Everything the pages hold
+    size_t GetUsedBytes() const;    // Only what regions cover
+    float GetOccupancy() const;     // Used / total, 1.0 when empty
+
+private:
+    struct SkylineNode
+    {
+        int x, y, width;
+    };
+    struct Page
+    {
+        int width = 0, height = 0;
+        std::vector<uint32_t> pixels;
+        std::vector<SkylineNode> skyline;
+    };
+
+    int pageWidth;
+    int maxPageHeight;
+    std::vector<Page> pages;
+    size_t usedPixels = 0;
+
+    bool Place(Page &page, int w, int h, int &outX, int &outY);
+};
@@ -0,0 +1,708 @@
+#include "benchmarks.h"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <cmath>
+#include <map>
+#include <fstream>
+#include <filesystem>
+#include "renderer.h"
+#include "timerWheel.h"
+#include "aliasTable.h"
+#include "expression.h"
+#include "stateTables.h"
+#include "conditionRegistry.h"
+#include "nlohmann/json.hpp"
+
+namespace {
+
+// Stand-in for a sprite: which timed transition state it's in, and when it entered it
+struct TimedSprite
+{
+    std::string state;
+    uint32_t entered = 0;
+    int intervals[4];
+    std::vector<TimerWheel::Handle> handles;
+};
+
+// EvaluateCondition as it was before conditions were compiled: the condition's name compared against each one in turn
+bool EvaluateConditionByName(const std::string &condition, float x, int width, int worldLeft, int screenWidth, bool &clicked, bool expired) {
+    if (condition == "atEndOfScreen" && x + width >= worldLeft + screenWidth) return true;
+    if (condition == "atStartOfScreen" && x <= worldLeft) return true;
+    if (condition == "randomInterval" || condition == "setInterval") return expired;
+    if (condition == "onClick") {
+        bool wasClicked = clicked;
+        clicked = false;
+        return wasClicked;
+    }
+    return false;
+}
+
+// Stand-in plugin conditions: each compares a different input against its own threshold
+int BenchmarkXAbove(const ConditionInputs *in, void *threshold) { return in->x > *static_cast<float *>(threshold); }
+int BenchmarkYAbove(const ConditionInputs *in, void *threshold) { return in->y > *static_cast<float *>(threshold); }
+int BenchmarkElapsedAbove(const ConditionInputs *in, void *threshold) { return in->elapsed > *static_cast<float *>(threshold); }
+
+// The state machine as CheckTransition used to see it: states by name, each with its transitions as written
+struct NamedTransition
+{
+    std::string to, condition;
+    float probability = 1.0f;
+};
+
+// CheckTransition before the tables: look the state up, group its transitions by condition name, compare the names
+// and re-sum the weights of a group that holds. Returns the state to be in after the check.
+const std::string &CheckTransitionByName(const std::map<std::string, std::vector<NamedTransition>> &states,
+                                         const std::string &current, float x, int width, int screenWidth, bool &clicked) {
+    const auto &transitions = states.at(current);
+    std::unordered_map<std::string, std::vector<NamedTransition>> conditionGroups;
+    for (const auto &transition : transitions) {
+        conditionGroups[transition.condition].push_back(transition);
+    }
+    for (const auto &[condition, group] : conditionGroups) {
+        for (size_t i = 0; i < group.size(); i++) {
+            if (!EvaluateConditionByName(condition, x, width, 0, screenWidth, clicked, false)) continue;
+            float totalWeight = 0.0f;
+            for (const auto &t : group) totalWeight += t.probability;
+            float r = static_cast<float>(std::rand()) / RAND_MAX * totalWeight;
+            float cumulative = 0.0f;
+            for (const auto &t : group) {
+                cumulative += t.probability;
+                if (r <= cumulative) return t.to;
+            }
+        }
+    }
+    return current;
+}
+
+// A flat machine with stateCount states, each with seven transitions of most kinds to random states
+nlohmann::ordered_json GenerateMachine(int stateCount) {
+    std::mt19937 random(1);
+    auto anyState = [&]() { return "s" + std::to_string(random() % stateCount); };
+    auto weight = [&]() { return 0.1 + (random() % 900) / 1000.0; };
+    nlohmann::ordered_json machine;
+    for (int i = 0; i < stateCount; i++) {
+        nlohmann::ordered_json transitions = nlohmann::ordered_json::array();
+        transitions.push_back({ { "to", "s" + std::to_string((i + 1) % stateCount) }, { "condition", "setInterval" }, { "intervalSet", 500 } });
+        transitions.push_back({ { "to", anyState() }, { "condition", "onClick" }, { "probability", weight() } });
+        transitions.push_back({ { "to", anyState() }, { "condition", "onClick" }, { "probability", weight() } });
+        transitions.push_back({ { "to", anyState() }, { "condition", "atEndOfScreen" } });
+        transitions.push_back({ { "to", anyState() }, { "condition", "atStartOfScreen" } });
+        transitions.push_back({ { "to", anyState() }, { "condition", "randomInterval" }, { "intervalMin", 1000 }, { "intervalMax", 3000 } });
+        transitions.push_back({ { "to", anyState() }, { "when", "x > screenW * 0.5 && elapsed > 800" }, { "probability", weight() } });
+        machine["s" + std::to_string(i)] = { { "animation", i % 2 ? "walkLeft" : "walkRight" }, { "transitions", transitions } };
+    }
+    return machine;
+}
+
+// One level of a binary hierarchy: the innermost states walk and turn around at the screen edges, every state
+// around them leaves after a while (later the deeper it is) and the outermost one on a click. flat gets the
+// innermost states with the transitions of everything around them appended, nearest first, which is what
+// loading the nested one does (none of the generated conditions override one another).
+nlohmann::ordered_json GenerateHierarchyLevel(const std::string &name, int depth, int maxDepth, std::mt19937 &random,
+                                              const nlohmann::ordered_json &outer, nlohmann::ordered_json &flat) {
+    auto anyLeaf = [&]() {
+        std::string leaf = "s";
+        uint32_t bits = random();
+        for (int level = 0; level < maxDepth; level++) leaf += (bits >> level) & 1 ? '1' : '0';
+        return leaf;
+    };
+    nlohmann::ordered_json state;
+    nlohmann::ordered_json transitions = nlohmann::ordered_json::array();
+    if (depth == maxDepth) {
+        state["animation"] = random() % 2 ? "walkLeft" : "walkRight";
+        transitions.push_back({ { "to", anyLeaf() }, { "condition", "atEndOfScreen" } });
+        transitions.push_back({ { "to", anyLeaf() }, { "condition", "atStartOfScreen" } });
+    } else {
+        transitions.push_back({ { "to", anyLeaf() }, { "when", "elapsed > " + std::to_string(1000 + 100 * depth) } });
+        if (depth == 0) transitions.push_back({ { "to", anyLeaf() }, { "condition", "onClick" } });
+    }
+    state["transitions"] = transitions;
+
+    nlohmann::ordered_json inherited = transitions;
+    for (const auto &transition : outer) inherited.push_back(transition);
+    if (depth == maxDepth) {
+        flat[name] = { { "animation", state["animation"] }, { "transitions", inherited } };
+    } else {
+        for (const char *child : { "0", "1" }) {
+            state["states"][name + child] = GenerateHierarchyLevel(name + child, depth + 1, maxDepth, random, inherited, flat);
+        }
+    }
+    return state;
+}
+
+bool WriteJson(const nlohmann::ordered_json &json, const std::string &path) {
+    std::ofstream file(path);
+    file << json.dump(1);
+    if (!file) {
+        std::cerr << "Couldn't write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Loads each state machine (best of five) and steps a sprite with it, clicking now and then; true if they all
+// took the same path
+bool BenchmarkMachines(const std::vector<std::string> &paths, long long steps) {
+    std::vector<long long> checksums;
+    for (const std::string &path : paths) {
+        ManualClock clock;
+        std::unique_ptr<Sprite> sprite;
+        double loadMs = 0;
+        for (int load = 0; load < 5; load++) {
+            double ms = 0;
+            sprite = MakeBenchSprite(clock, path, 1920, 1080, &ms);
+            if (!sprite) return false;
+            loadMs = load == 0 ? ms : std::min(loadMs, ms);
+        }
+        sprite->SetPosition(500, 500);
+
+        long long checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < steps; n++) {
+            clock.AdvanceMs(Sprite::SIM_STEP_MS);
+            if (n % 5000 == 0) sprite->OnMouseClick(sprite->GetX() + sprite->GetWidth() / 2, sprite->GetY() + sprite->GetHeight() / 2);
+            sprite->Update();
+            checksum += sprite->GetX() * 4 + sprite->GetPhase();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << path << ": loaded in " << loadMs << " ms, " << seconds * 1e9 / steps
+                  << " ns per step, position checksum " << checksum << std::endl;
+        checksums.push_back(checksum);
+    }
+    bool same = std::all_of(checksums.begin(), checksums.end(), [&](long long checksum) { return checksum == checksums[0]; });
+    std::cout << "  " << (same ? "Same trajectory: OK" : "Trajectories differ: FAILED") << std::endl;
+    return same;
+}
+
+// Writes the precompiled form next to jsonPath, as smc does
+bool Precompile(const std::string &jsonPath, const std::string &binaryPath) {
+    StateMachine machine;
+    return machine.LoadJson(jsonPath) && machine.SaveBinary(binaryPath);
+}
+
+}
+
+std::unique_ptr<Sprite> MakeBenchSprite(const Clock &clock, const std::string &stateMachinePath, int screenWidth,
+                                        int screenHeight, double *loadMs) {
+    auto sprite = std::make_unique<Sprite>(screenWidth, screenHeight, clock);
+    sprite->LoadAnimations("animations");
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!sprite->LoadStateMachine(stateMachinePath)) return nullptr;
+    if (loadMs) *loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+    sprite->SetHeight(150);
+    sprite->SetPosition(screenWidth - 3 * sprite->GetWidth(), screenHeight - sprite->GetHeight() - 50);
+    return sprite;
+}
+
+void RunTimerBenchmark(int spriteCount) {
+    const int TRANSITIONS = 4;
+    const uint32_t STEP_MS = Sprite::SIM_STEP_MS, DURATION_MS = 60000;
+    std::vector<TimedSprite> sprites(spriteCount);
+    uint32_t seed = 1;
+    for (auto &sprite : sprites) {
+        for (int &interval : sprite.intervals) {
+            seed = seed * 1664525u + 1013904223u;
+            interval = 500 + static_cast<int>((seed >> 8) % 9500);
+        }
+    }
+
+    auto report = [&](const char *name, double seconds, long long fired) {
+        std::cout << "  " << name << ": " << seconds * 1000 << " ms, "
+                  << seconds * 1e9 / (static_cast<double>(DURATION_MS / STEP_MS) * spriteCount) << " ns per sprite step, "
+                  << fired << " transitions" << std::endl;
+    };
+    std::cout << "Timer benchmark: " << spriteCount << " sprites x " << TRANSITIONS << " timed transitions, "
+              << DURATION_MS / 1000 << " simulated s" << std::endl;
+
+    // Polling: every step looks up each sprite's start time by state name and checks every interval
+    {
+        std::vector<std::unordered_map<std::string, uint32_t>> startTimes(spriteCount);
+        for (int i = 0; i < spriteCount; i++) {
+            sprites[i].state = "state" + std::to_string(i % 4);
+            startTimes[i][sprites[i].state] = 0;
+        }
+        long long fired = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t now = STEP_MS; now <= DURATION_MS; now += STEP_MS) {
+            for (int i = 0; i < spriteCount; i++) {
+                TimedSprite &sprite = sprites[i];
+                for (int t = 0; t < TRANSITIONS; t++) {
+                    if (now - startTimes[i][sprite.state] >= static_cast<uint32_t>(sprite.intervals[t])) {
+                        startTimes[i][sprite.state] = now; // Re-entered
+                        fired++;
+                        break;
+                    }
+                }
+            }
+        }
+        report("polling", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), fired);
+    }
+
+    // A wheel per sprite, like Sprite: expiry re-enters the state and re-arms its timers
+    {
+        std::vector<TimerWheel> wheels(spriteCount);
+        for (int i = 0; i < spriteCount; i++) {
+            for (int t = 0; t < TRANSITIONS; t++) sprites[i].handles.push_back(wheels[i].Schedule(sprites[i].intervals[t], t));
+        }
+        std::vector<uint32_t> expired;
+        long long fired = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t now = STEP_MS; now <= DURATION_MS; now += STEP_MS) {
+            for (int i = 0; i < spriteCount; i++) {
+                expired.clear();
+                wheels[i].Advance(now, expired);
+                if (expired.empty()) continue;
+                TimedSprite &sprite = sprites[i];
+                for (auto handle : sprite.handles) wheels[i].Cancel(handle);
+                sprite.handles.clear();
+                for (int t = 0; t < TRANSITIONS; t++) sprite.handles.push_back(wheels[i].Schedule(now + sprite.intervals[t], t));
+                fired++;
+            }
+        }
+        report("wheel per sprite", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), fired);
+    }
+
+    // One wheel for everyone: a step only touches the sprites whose timers expire
+    {
+        TimerWheel wheel;
+        for (int i = 0; i < spriteCount; i++) {
+            sprites[i].handles.clear();
+            for (int t = 0; t < TRANSITIONS; t++) sprites[i].handles.push_back(wheel.Schedule(sprites[i].intervals[t], i));
+        }
+        std::vector<uint32_t> expired;
+        long long fired = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t now = STEP_MS; now <= DURATION_MS; now += STEP_MS) {
+            expired.clear();
+            wheel.Advance(now, expired);
+            for (uint32_t i : expired) {
+                TimedSprite &sprite = sprites[i];
+                if (sprite.handles.empty()) continue; // Another of its timers already fired this step
+                for (auto handle : sprite.handles) wheel.Cancel(handle);
+                sprite.handles.clear();
+            }
+            for (uint32_t i : expired) {
+                TimedSprite &sprite = sprites[i];
+                if (!sprite.handles.empty()) continue;
+                for (int t = 0; t < TRANSITIONS; t++) sprite.handles.push_back(wheel.Schedule(now + sprite.intervals[t], i));
+                fired++;
+            }
+        }
+        report("shared wheel", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), fired);
+    }
+}
+
+void RunExpressionBenchmark(long long evaluations) {
+    const int WIDTH = 100, SCREEN_WIDTH = 1920;
+    std::cout << "Expression benchmark: " << evaluations << " evaluations each" << std::endl;
+    auto report = [&](const std::string &name, double seconds, long long held) {
+        std::cout << "  " << name << ": " << seconds * 1e9 / evaluations << " ns per evaluation, " << held << " held" << std::endl;
+    };
+
+    // The position moves every evaluation so nothing can be hoisted out of the loop
+    const std::string names[] = { "atEndOfScreen", "atStartOfScreen", "setInterval", "onClick" };
+    for (const std::string &name : names) {
+        bool clicked = false;
+        long long held = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < evaluations; n++) {
+            clicked = (n & 7) == 0;
+            held += EvaluateConditionByName(name, static_cast<float>(n % 2000), WIDTH, 0, SCREEN_WIDTH, clicked, (n & 3) == 0);
+        }
+        report("by name, " + name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), held);
+    }
+
+    const char *expressions[] = { "x + width >= left + screenW", "clicked()", "x > screenW * 0.8 && elapsed > 400 && rand() < 0.3" };
+    std::vector<ExpressionInstruction> code;
+    std::vector<float> constants;
+    std::mt19937 random(1);
+    for (const char *text : expressions) {
+        ExpressionProgram program;
+        std::string error;
+        if (!CompileExpression(text, code, constants, program, error)) {
+            std::cerr << error << std::endl;
+            return;
+        }
+        bool clicked = false;
+        ExpressionContext context;
+        context.random = &random;
+        context.clicked = &clicked;
+        context.variables[static_cast<int>(ExpressionVariable::Width)] = WIDTH;
+        context.variables[static_cast<int>(ExpressionVariable::ScreenW)] = SCREEN_WIDTH;
+        long long held = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < evaluations; n++) {
+            clicked = (n & 7) == 0;
+            context.variables[static_cast<int>(ExpressionVariable::X)] = static_cast<float>(n % 2000);
+            context.variables[static_cast<int>(ExpressionVariable::Elapsed)] = static_cast<float>(n % 1000);
+            held += RunExpression(code.data(), constants.data(), program, context);
+        }
+        report("bytecode (" + std::to_string(program.instructionCount) + " instructions), " + text,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), held);
+    }
+}
+
+// Draws from one group of weighted transitions, re-summing and scanning the weights on every pick like
+// CheckTransition used to vs. an alias table, and checks the alias table's picks against the weights
+bool RunAliasBenchmark(int targetCount) {
+    const long long DRAWS = 10000000;
+    std::mt19937 random(1);
+    std::vector<float> weights(targetCount);
+    for (int i = 0; i < targetCount; i++) {
+        weights[i] = i % 4 == 3 ? 0.0f : std::uniform_real_distribution<float>(0.01f, 1.0f)(random);
+    }
+    std::vector<AliasEntry> table(targetCount);
+    BuildAliasTable(weights.data(), targetCount, table.data());
+    std::cout << "Alias benchmark: " << targetCount << " targets (every 4th weighted 0), " << DRAWS << " draws" << std::endl;
+
+    std::vector<long long> counts(targetCount);
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long n = 0; n < DRAWS; n++) {
+        float total = 0.0f;
+        for (float weight : weights) total += weight;
+        float r = std::uniform_real_distribution<float>(0.0f, total)(random);
+        float cumulative = 0.0f;
+        int pick = targetCount - 1;
+        for (int i = 0; i < targetCount; i++) {
+            cumulative += weights[i];
+            if (r <= cumulative) {
+                pick = i;
+                break;
+            }
+        }
+        checksum += pick;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  linear scan: " << seconds * 1e9 / DRAWS << " ns per pick (checksum " << checksum << ")" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (long long n = 0; n < DRAWS; n++) {
+        uint32_t columnBits = random(), coinBits = random();
+        counts[SampleAliasTable(table.data(), targetCount, columnBits, coinBits)]++;
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  alias table: " << seconds * 1e9 / DRAWS << " ns per pick" << std::endl;
+
+    // Pearson's chi-squared over the weighted targets; zero weighted ones must never come up
+    double total = 0;
+    for (float weight : weights) total += weight;
+    double chiSquared = 0, worstError = 0;
+    int degrees = -1;
+    long long zeroPicks = 0;
+    for (int i = 0; i < targetCount; i++) {
+        if (weights[i] <= 0) {
+            zeroPicks += counts[i];
+            continue;
+        }
+        double expected = DRAWS * weights[i] / total;
+        chiSquared += (counts[i] - expected) * (counts[i] - expected) / expected;
+        worstError = std::max(worstError, std::fabs(counts[i] - expected) / expected);
+        degrees++;
+    }
+    // chi-squared with k degrees of freedom is about normal with mean k and variance 2k
+    double z = degrees > 0 ? (chiSquared - degrees) / std::sqrt(2.0 * degrees) : 0;
+    bool pass = zeroPicks == 0 && std::fabs(z) < 5;
+    std::cout << "  chi-squared " << chiSquared << " over " << degrees << " degrees of freedom (z " << z
+              << "), worst target off by " << worstError * 100 << "%, zero weight picks " << zeroPicks
+              << (pass ? ": OK" : ": FAILED") << std::endl;
+    return pass;
+}
+
+void RunPluginBenchmark(long long evaluations) {
+    const int CONDITIONS = 100;
+    ConditionRegistry registry;
+    std::vector<std::string> names;
+    std::vector<float> thresholds(CONDITIONS);
+    ConditionFunction functions[] = { BenchmarkXAbove, BenchmarkYAbove, BenchmarkElapsedAbove };
+    for (int i = 0; i < CONDITIONS; i++) {
+        names.push_back("condition" + std::to_string(i));
+        thresholds[i] = static_cast<float>(i * 10);
+        registry.Register(names[i], functions[i % 3], EVENT_POSITION, &thresholds[i]);
+    }
+    // What loading a state machine does once
+    std::vector<const ConditionRegistry::Entry *> resolved;
+    for (const std::string &name : names) resolved.push_back(registry.Find(name));
+
+    std::cout << "Plugin condition benchmark: " << CONDITIONS << " registered, " << evaluations << " evaluations each" << std::endl;
+    // The condition asked for jumps around so the branch predictor can't learn the order
+    auto conditionAt = [&](long long n) { return static_cast<int>((n * 37) % CONDITIONS); };
+    ConditionInputs inputs = {};
+    auto run = [&](const char *name, auto &&evaluate) {
+        long long held = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < evaluations; n++) {
+            inputs.x = inputs.y = inputs.elapsed = static_cast<float>(n % 1000);
+            held += evaluate(conditionAt(n));
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << name << ": " << seconds * 1e9 / evaluations << " ns per evaluation, " << held << " held" << std::endl;
+    };
+    run("name compared in a chain", [&](int condition) {
+        const std::string &wanted = names[condition];
+        for (int i = 0; i < CONDITIONS; i++) {
+            if (wanted == names[i]) return functions[i % 3](&inputs, &thresholds[i]);
+        }
+        return 0;
+    });
+    run("looked up by name", [&](int condition) {
+        const ConditionRegistry::Entry *entry = registry.Find(names[condition]);
+        return entry->function(&inputs, entry->userData);
+    });
+    run("resolved function pointer", [&](int condition) {
+        const ConditionRegistry::Entry *entry = resolved[condition];
+        return entry->function(&inputs, entry->userData);
+    });
+}
+
+
+// Runs the same sprite with stateMachine.json loaded at runtime and with the tables compiled in,
+// clicking it now and then; both take exactly the same transitions
+bool RunTablesBenchmark(long long steps) {
+    std::cout << "State tables benchmark: " << steps << " steps each" << std::endl;
+    long long checksums[2] = {};
+    for (int compiled = 0; compiled < 2; compiled++) {
+        ManualClock clock;
+        std::unique_ptr<Sprite> sprite;
+        // LoadStateTables loads the animations along with the tables, so both ways are timed until the sprite is ready
+        auto loadStart = std::chrono::steady_clock::now();
+        if (compiled) {
+            sprite = std::make_unique<Sprite>(1920, 1080, clock);
+            sprite->LoadStateTables<StateTables>();
+            sprite->SetHeight(150);
+            sprite->SetPosition(1920 - 3 * sprite->GetWidth(), 1080 - sprite->GetHeight() - 50);
+        } else {
+            sprite = MakeBenchSprite(clock, "stateMachine.json");
+            if (!sprite) return false;
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < steps; n++) {
+            clock.AdvanceMs(Sprite::SIM_STEP_MS);
+            if (n % 1000 == 0) sprite->OnMouseClick(sprite->GetX() + sprite->GetWidth() / 2, sprite->GetY() + sprite->GetHeight() / 2);
+            sprite->Update();
+            checksums[compiled] += sprite->GetX() * 4 + sprite->GetPhase();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << (compiled ? "compiled in (stateTables.h)" : "runtime (stateMachine.json)") << ": loaded in " << loadMs
+                  << " ms, " << seconds * 1e9 / steps << " ns per step, position checksum " << checksums[compiled] << std::endl;
+    }
+    bool same = checksums[0] == checksums[1];
+    std::cout << "  " << (same ? "Same trajectory: OK" : "Trajectories differ: FAILED") << std::endl;
+    return same;
+}
+
+bool RunCheckBenchmark(long long checks) {
+    const int SCREEN_WIDTH = 1920, SCREEN_HEIGHT = 1080;
+    std::cout << "CheckTransition benchmark: walkRight mid-screen, " << checks << " checks each" << std::endl;
+
+    std::ifstream file("stateMachine.json");
+    nlohmann::json json = nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded()) {
+        std::cerr << "Couldn't parse stateMachine.json" << std::endl;
+        return false;
+    }
+    std::map<std::string, std::vector<NamedTransition>> states;
+    for (auto &[name, state] : json.items()) {
+        auto &transitions = states[name];
+        for (const auto &transition : state.value("transitions", nlohmann::json::array())) {
+            transitions.push_back({ transition.value("to", ""), transition.value("condition", ""), transition.value("probability", 1.0f) });
+        }
+    }
+
+    ManualClock clock;
+    auto sprite = MakeBenchSprite(clock, "stateMachine.json", SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (!sprite) return false;
+    sprite->SetPosition(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+
+    // The position moves every check so nothing can be hoisted out of the loop
+    const std::string walkRight = "walkRight";
+    bool clicked = false;
+    long long stayed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long n = 0; n < checks; n++) {
+        float x = static_cast<float>(SCREEN_WIDTH / 2 + (n & 255));
+        stayed += &CheckTransitionByName(states, walkRight, x, sprite->GetWidth(), SCREEN_WIDTH, clicked) == &walkRight;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  by name: " << seconds * 1e9 / checks << " ns per check, stayed " << stayed << std::endl;
+
+    // Every event raised, so each check looks at all of walkRight's groups like the name-based one does
+    long long positions = 0;
+    start = std::chrono::steady_clock::now();
+    for (long long n = 0; n < checks; n++) {
+        sprite->CheckTransitionNow(EVENT_ALL);
+        positions += sprite->GetX();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  tables: " << seconds * 1e9 / checks << " ns per check (" << positions << ")" << std::endl;
+    return true;
+}
+
+bool RunEventsBenchmark(long long steps) {
+    // Timers far beyond the run so the sprite stays idle throughout
+    const uint32_t NEVER_MS = static_cast<uint32_t>(std::min<long long>(steps * Sprite::SIM_STEP_MS * 2 + 60000, 2000000000));
+    nlohmann::json transitions = nlohmann::json::array();
+    for (int i = 0; i < 100; i++) {
+        transitions.push_back({ { "to", "walkLeft" }, { "condition", "setInterval" }, { "intervalSet", NEVER_MS + i } });
+        transitions.push_back({ { "to", "walkLeft" }, { "condition", "randomInterval" }, { "intervalMin", NEVER_MS + i }, { "intervalMax", NEVER_MS + 1000 + i } });
+    }
+    for (int i = 0; i < 50; i++) {
+        transitions.push_back({ { "to", "walkLeft" }, { "condition", "onClick" } });
+        transitions.push_back({ { "to", "walkLeft" }, { "condition", "atEndOfScreen" } });
+    }
+    nlohmann::ordered_json machine;
+    machine["idle"] = { { "animation", "spinRight" }, { "transitions", transitions } };
+    machine["walkLeft"] = { { "animation", "walkLeft" } };
+    std::string path = (std::filesystem::temp_directory_path() / "eventsBench.json").string();
+    std::ofstream(path) << machine.dump();
+
+    std::cout << "Events benchmark: idle state with " << transitions.size() << " transitions, " << steps << " steps each" << std::endl;
+    bool ok = true;
+    for (int everyGroup = 0; everyGroup < 2 && ok; everyGroup++) {
+        ManualClock clock;
+        auto sprite = MakeBenchSprite(clock, path);
+        if (!sprite) {
+            ok = false;
+            break;
+        }
+        sprite->SetPosition(500, 500);
+        sprite->Update();
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < steps; n++) {
+            clock.AdvanceMs(Sprite::SIM_STEP_MS);
+            sprite->Update();
+            // What a step cost when every group was evaluated whatever had happened
+            if (everyGroup) sprite->CheckTransitionNow(EVENT_ALL);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << (everyGroup ? "every group every step" : "only after their events") << ": "
+                  << seconds * 1e9 / steps << " ns per step" << std::endl;
+    }
+    std::filesystem::remove(path);
+    return ok;
+}
+
+bool RunLoadBenchmark(int stateCount) {
+    const long long STEPS = 1000000;
+    std::string folder = std::filesystem::temp_directory_path().string();
+    std::string jsonPath = folder + "/loadBench.json", binaryPath = folder + "/loadBench.bin";
+    if (!WriteJson(GenerateMachine(stateCount), jsonPath) || !Precompile(jsonPath, binaryPath)) return false;
+    std::cout << "Load benchmark: " << stateCount << " states, " << 7 * stateCount << " transitions ("
+              << std::filesystem::file_size(jsonPath) / 1024 << " KB JSON, " << std::filesystem::file_size(binaryPath) / 1024
+              << " KB precompiled), " << STEPS << " steps each" << std::endl;
+    return BenchmarkMachines({ jsonPath, binaryPath }, STEPS);
+}
+
+bool RunHierarchyBenchmark(int depth) {
+    const long long STEPS = 1000000;
+    std::string folder = std::filesystem::temp_directory_path().string();
+    std::string nestedPath = folder + "/hierarchyBench.json", flatPath = folder + "/hierarchyBenchFlat.json";
+    std::string binaryPath = folder + "/hierarchyBench.bin";
+    std::mt19937 random(1);
+    nlohmann::ordered_json nested, flat;
+    nested["s"] = GenerateHierarchyLevel("s", 0, depth, random, nlohmann::ordered_json::array(), flat);
+    if (!WriteJson(nested, nestedPath) || !WriteJson(flat, flatPath) || !Precompile(nestedPath, binaryPath)) return false;
+    std::cout << "Hierarchy benchmark: " << depth << " levels, " << flat.size() << " innermost states, "
+              << STEPS << " steps each" << std::endl;
+    return BenchmarkMachines({ nestedPath, flatPath, binaryPath }, STEPS);
+}
+
+// Headless stand-in for frameBench.exe, which measures the real DIB sections: a buffer allocated every frame
+// against one kept across frames, drawn the same way
+void RunFrameBenchmark(long long frames, int screenWidth, int screenHeight) {
+    std::cout << "Frame benchmark (headless proxy, see frameBench.exe for the GDI path): " << frames << " frames each into a "
+              << screenWidth << "x" << screenHeight << " buffer" << std::endl;
+    for (int persistent = 0; persistent < 2; persistent++) {
+        ManualClock clock;
+        auto sprite = MakeBenchSprite(clock, "stateMachine.json", screenWidth, screenHeight);
+        if (!sprite) return;
+        HeadlessRenderer kept(screenWidth, screenHeight);
+        int keptBefore = kept.GetAllocationCount();
+        long long allocations = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (long long n = 0; n < frames; n++) {
+            clock.AdvanceMs(Sprite::SIM_STEP_MS);
+            sprite->Update();
+            if (persistent) {
+                kept.Resize(screenWidth, screenHeight); // Only reallocates when the size changed
+                kept.Clear();
+                sprite->Draw(kept);
+            } else {
+                HeadlessRenderer fresh(screenWidth, screenHeight);
+                fresh.Clear();
+                sprite->Draw(fresh);
+                allocations += fresh.GetAllocationCount();
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (persistent) allocations = kept.GetAllocationCount() - keptBefore;
+        std::cout << "  " << (persistent ? "buffer kept across frames" : "new buffer every frame") << ": "
+                  << seconds * 1e6 / frames << " us per frame, "
+                  << static_cast<double>(allocations) / frames << " buffer allocations per frame" << std::endl;
+    }
+}
+
+bool RunBlitBenchmark(long long blits) {
+    Image cat;
+    if (!LoadImageFile("img/walkRight1.png", cat)) {
+        std::cerr << "Couldn't load img/walkRight1.png" << std::endl;
+        return false;
+    }
+    std::cout << "Blitter benchmark: " << blits << " blits per size and kernel" << std::endl;
+    uint32_t sink = 0;
+    for (int height : { 150, 512, 1024 }) {
+        int width = std::max(cat.width * height / cat.height, 1);
+        std::vector<uint32_t> frame(static_cast<size_t>(width) * height);
+        ScaleImage(cat.View(), frame.data(), width, width, height);
+        AlphaSpans spans;
+        EncodeAlphaSpans(frame.data(), width, height, width, spans);
+
+        std::vector<uint32_t> background(frame.size(), 0x80402010u);
+        std::vector<uint32_t> pixels(frame.size());
+        Surface surface;
+        surface.pixels = pixels.data();
+        surface.width = width;
+        surface.height = height;
+        surface.stride = width;
+        // A fresh background before every blit, or blending converges on the sprite and stops being realistic.
+        // That copy is as big as the blit, so it's timed on its own and taken out of the numbers.
+        enum { COPY_ONLY, RECT, SPANS };
+        auto timeBlits = [&](int mode) {
+            auto start = std::chrono::steady_clock::now();
+            for (long long n = 0; n < blits; n++) {
+                std::copy(background.begin(), background.end(), pixels.begin());
+                if (mode == SPANS) {
+                    BlendImageSpans(surface, 0, 0, frame.data(), width, spans);
+                } else if (mode == RECT) {
+                    BlendImage(surface, 0, 0, frame.data(), width, height, width);
+                }
+            }
+            sink += pixels[pixels.size() / 2];
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+        double copySeconds = timeBlits(COPY_ONLY);
+        std::cout << "  " << width << "x" << height << " (background copy " << copySeconds * 1e9 / blits << " ns per blit, not counted):" << std::endl;
+        for (BlitPath path : { BlitPath::Scalar, BlitPath::SSE2, BlitPath::AVX2 }) {
+            SetBlitPath(path);
+            if (GetBlitPath() != path) continue;
+            double mpixels[2];
+            for (int useSpans = 0; useSpans < 2; useSpans++) {
+                double seconds = std::max(timeBlits(useSpans ? SPANS : RECT) - copySeconds, 1e-9);
+                mpixels[useSpans] = static_cast<double>(frame.size()) * blits / seconds / 1e6;
+            }
+            std::cout << "    " << GetBlitPathName(path) << ": " << mpixels[0] << " Mpixels/s, with alpha spans "
+                      << mpixels[1] << " Mpixels/s" << std::endl;
+        }
+    }
+    // Keeps the copies and blends from being optimized away
+    if (sink == 1) std::cout << std::endl;
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "sprite.h"
+
+// The benchmark modes of headless_sim (see the options at the top of headless_sim.cpp). Run from the repo
+// root so the animations/ and img/ paths resolve. Those returning bool return false if a check failed or
+// something couldn't be loaded.
+
+// A sprite on a screenWidth x screenHeight screen driven by clock, with the animations and the state machine
+// at stateMachinePath loaded, 150 pixels high at its usual spot near the bottom right. Null if the state
+// machine didn't load. loadMs, if given, gets how long loading the state machine took.
+std::unique_ptr<Sprite> MakeBenchSprite(const Clock &clock, const std::string &stateMachinePath, int screenWidth = 1920,
+                                        int screenHeight = 1080, double *loadMs = nullptr);
+
+void RunTimerBenchmark(int spriteCount);
+void RunExpressionBenchmark(long long evaluations);
+bool RunAliasBenchmark(int targetCount);
+void RunPluginBenchmark(long long evaluations);
+bool RunTablesBenchmark(long long steps);
+bool RunCheckBenchmark(long long checks);
+bool RunEventsBenchmark(long long steps);
+bool RunLoadBenchmark(int stateCount);
+bool RunHierarchyBenchmark(int depth);
+void RunFrameBenchmark(long long frames, int screenWidth, int screenHeight);
+bool RunBlitBenchmark(long long blits);
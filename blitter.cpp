@@ -0,0 +1,410 @@
+#include "blitter.h"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BLITTER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets us use any intrinsic anywhere, GCC/Clang need the function to be compiled for the target
+#if defined(BLITTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BLITTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BLITTER_TARGET(isa)
+#endif
+
+namespace {
+
+// Exact round(x / 255) for x in [0, 255 * 255]
+inline uint32_t Div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline uint32_t BlendPixel(uint32_t d, uint32_t s)
+{
+    uint32_t inv = 255 - (s >> 24);
+    if (inv == 0) return s;
+    if (inv == 255) return d;
+
+    uint32_t b = Div255((d & 0xFF) * inv);
+    uint32_t g = Div255(((d >> 8) & 0xFF) * inv);
+    uint32_t r = Div255(((d >> 16) & 0xFF) * inv);
+    uint32_t a = Div255((d >> 24) * inv);
+    // Premultiplied input can't overflow a channel, so the sum is per-byte
+    return s + (b | (g << 8) | (r << 16) | (a << 24));
+}
+
+#ifdef BLITTER_X86
+
+// Mirror = true reads src right to left: dst[i] is blended with src[count - 1 - i]
+template <bool Mirror>
+BLITTER_TARGET("sse2")
+void BlendRowSSE2(uint32_t *dst, const uint32_t *src, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s;
+        if (Mirror) {
+            s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + count - 4 - i));
+            s = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3));
+        } else {
+            s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        }
+
+        // Fully transparent: nothing to do. Fully opaque: plain copy.
+        __m128i sa = _mm_and_si128(s, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xFFFF) continue;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alphaMask)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), s);
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+
+        // Alpha of each pixel in both 16-bit halves of its 32-bit lane, then spread to 4 channels
+        __m128i a = _mm_srli_epi32(s, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i invLo = _mm_sub_epi16(c255, _mm_unpacklo_epi32(a, a));
+        __m128i invHi = _mm_sub_epi16(c255, _mm_unpackhi_epi32(a, a));
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), invLo), c128);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), invHi), c128);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        __m128i result = _mm_adds_epu8(_mm_packus_epi16(lo, hi), s);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), result);
+    }
+    for (; i < count; i++) {
+        dst[i] = BlendPixel(dst[i], src[Mirror ? count - 1 - i : i]);
+    }
+}
+
+template <bool Mirror>
+BLITTER_TARGET("avx2")
+void BlendRowAVX2(uint32_t *dst, const uint32_t *src, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s;
+        if (Mirror) {
+            s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + count - 8 - i));
+            s = _mm256_permutevar8x32_epi32(s, reverse);
+        } else {
+            s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        }
+
+        __m256i sa = _mm256_and_si256(s, alphaMask);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1) continue;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alphaMask)) == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), s);
+            continue;
+        }
+
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+
+        // Unpack and pack both work per 128-bit lane, so the pixel order comes back out unchanged
+        __m256i a = _mm256_srli_epi32(s, 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        __m256i invLo = _mm256_sub_epi16(c255, _mm256_unpacklo_epi32(a, a));
+        __m256i invHi = _mm256_sub_epi16(c255, _mm256_unpackhi_epi32(a, a));
+
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), invLo), c128);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), invHi), c128);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+        __m256i result = _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), result);
+    }
+    // The rest of a mirrored row is the start of src
+    if (i < count) BlendRowSSE2<Mirror>(dst + i, Mirror ? src : src + i, count - i);
+}
+
+bool CpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true; // Part of the x86-64 baseline
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool CpuHasAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false; // OS saves the YMM registers
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // BLITTER_X86
+
+using BlendRowFn = void (*)(uint32_t *, const uint32_t *, int);
+
+void BlendRowMirroredScalar(uint32_t *dst, const uint32_t *src, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dst[i] = BlendPixel(dst[i], src[count - 1 - i]);
+    }
+}
+
+bool IsSupported(BlitPath path)
+{
+    switch (path) {
+        case BlitPath::Scalar: return true;
+#ifdef BLITTER_X86
+        case BlitPath::SSE2: return CpuHasSSE2();
+        case BlitPath::AVX2: return CpuHasAVX2();
+#endif
+        default: return false;
+    }
+}
+
+BlitPath DetectBlitPath()
+{
+    if (IsSupported(BlitPath::AVX2)) return BlitPath::AVX2;
+    if (IsSupported(BlitPath::SSE2)) return BlitPath::SSE2;
+    return BlitPath::Scalar;
+}
+
+BlendRowFn GetBlendRowFn(BlitPath path, bool mirror)
+{
+    switch (path) {
+#ifdef BLITTER_X86
+        case BlitPath::SSE2: return mirror ? BlendRowSSE2<true> : BlendRowSSE2<false>;
+        case BlitPath::AVX2: return mirror ? BlendRowAVX2<true> : BlendRowAVX2<false>;
+#endif
+        default: return mirror ? BlendRowMirroredScalar : BlendRowScalar;
+    }
+}
+
+BlitPath currentPath = DetectBlitPath();
+BlendRowFn blendRow = GetBlendRowFn(currentPath, false);
+BlendRowFn blendRowMirrored = GetBlendRowFn(currentPath, true);
+
+} // namespace
+
+BlitPath GetBlitPath()
+{
+    return currentPath;
+}
+
+void SetBlitPath(BlitPath path)
+{
+    currentPath = IsSupported(path) ? path : BlitPath::Scalar;
+    blendRow = GetBlendRowFn(currentPath, false);
+    blendRowMirrored = GetBlendRowFn(currentPath, true);
+}
+
+const char *GetBlitPathName(BlitPath path)
+{
+    switch (path) {
+        case BlitPath::SSE2: return "SSE2";
+        case BlitPath::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+void BlendRowScalar(uint32_t *dst, const uint32_t *src, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dst[i] = BlendPixel(dst[i], src[i]);
+    }
+}
+
+void BlendRow(uint32_t *dst, const uint32_t *src, int count)
+{
+    blendRow(dst, src, count);
+}
+
+void BlendRowMirrored(uint32_t *dst, const uint32_t *src, int count)
+{
+    blendRowMirrored(dst, src, count);
+}
+
+void BlendImage(Surface &dst, int x, int y, const uint32_t *src, int srcWidth, int srcHeight, int srcStride,
+                bool mirror)
+{
+    // Into surface space, then clip
+    int left = x - dst.originX;
+    int top = y - dst.originY;
+    int x0 = std::max(left, 0);
+    int y0 = std::max(top, 0);
+    int x1 = std::min(left + srcWidth, dst.width);
+    int y1 = std::min(top + srcHeight, dst.height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    // Mirrored, the visible columns come from the opposite side of the source
+    int srcX = mirror ? srcWidth - (x1 - left) : x0 - left;
+    BlendRowFn blend = mirror ? blendRowMirrored : blendRow;
+    for (int row = y0; row < y1; row++) {
+        const uint32_t *srcRow = src + static_cast<size_t>(row - top) * srcStride + srcX;
+        uint32_t *dstRow = dst.pixels + static_cast<size_t>(row) * dst.stride + x0;
+        blend(dstRow, srcRow, x1 - x0);
+    }
+}
+
+void EncodeAlphaSpans(const uint32_t *src, int width, int height, int stride, AlphaSpans &out)
+{
+    // Copying only pays off for longer runs, and blending a transparent or opaque pixel gives the
+    // same result as skipping or copying it, so short runs are folded into the partial run around them
+    const int MIN_COPY_RUN = 8;
+    const int MIN_SKIP_RUN = 4;
+    const int BLEND_BLOCK = 8; // Pixels per AVX2 iteration
+
+    out.width = width;
+    out.height = height;
+    out.spans.clear();
+    out.rowStarts.assign(1, 0);
+    out.copiedPixels = out.blendedPixels = 0;
+
+    for (int row = 0; row < height; row++) {
+        const uint32_t *pixels = src + static_cast<size_t>(row) * stride;
+        size_t rowStart = out.spans.size();
+
+        int col = 0;
+        while (col < width) {
+            uint32_t alpha = pixels[col] >> 24;
+            int end = col + 1;
+            while (end < width && ((pixels[end] >> 24) == alpha || (alpha != 0 && alpha != 255 &&
+                                   (pixels[end] >> 24) != 0 && (pixels[end] >> 24) != 255))) {
+                end++;
+            }
+
+            bool transparent = alpha == 0;
+            bool opaque = alpha == 255 && end - col >= MIN_COPY_RUN;
+            int length = end - col;
+
+            // Short gaps and short opaque runs extend the partial run right before them
+            if (!opaque && out.spans.size() > rowStart) {
+                AlphaSpan &last = out.spans.back();
+                if (!last.opaque && last.start + last.length == col && (!transparent || length < MIN_SKIP_RUN)) {
+                    last.length = static_cast<uint16_t>(last.length + length);
+                    col = end;
+                    continue;
+                }
+            }
+            if (transparent) {
+                col = end;
+                continue;
+            }
+
+            AlphaSpan span;
+            span.start = static_cast<uint16_t>(col);
+            span.length = static_cast<uint16_t>(length);
+            span.opaque = opaque;
+            out.spans.push_back(span);
+            col = end;
+        }
+
+        // Round partial runs out to whole SIMD blocks so the blend kernels never take their scalar tail.
+        // Blending the extra transparent (or opaque) pixels is exact, but overlapping partial runs are merged
+        // so nothing gets blended twice.
+        size_t kept = rowStart;
+        for (size_t i = rowStart; i < out.spans.size(); i++) {
+            AlphaSpan span = out.spans[i];
+            if (!span.opaque) {
+                int start = span.start & ~(BLEND_BLOCK - 1);
+                int end = std::min((span.start + span.length + BLEND_BLOCK - 1) & ~(BLEND_BLOCK - 1), width);
+                span.start = static_cast<uint16_t>(start);
+                span.length = static_cast<uint16_t>(end - start);
+                if (kept > rowStart && !out.spans[kept - 1].opaque &&
+                    out.spans[kept - 1].start + out.spans[kept - 1].length >= start) {
+                    AlphaSpan &last = out.spans[kept - 1];
+                    last.length = static_cast<uint16_t>(end - last.start);
+                    continue;
+                }
+            }
+            out.spans[kept++] = span;
+        }
+        out.spans.resize(kept);
+
+        for (size_t i = rowStart; i < out.spans.size(); i++) {
+            (out.spans[i].opaque ? out.copiedPixels : out.blendedPixels) += out.spans[i].length;
+        }
+        out.rowStarts.push_back(static_cast<uint32_t>(out.spans.size()));
+    }
+}
+
+void BlendImageSpans(Surface &dst, int x, int y, const uint32_t *src, int srcStride, const AlphaSpans &spans,
+                     bool mirror)
+{
+    // Into surface space, then clip
+    int left = x - dst.originX;
+    int top = y - dst.originY;
+    int x0 = std::max(left, 0);
+    int y0 = std::max(top, 0);
+    int x1 = std::min(left + spans.width, dst.width);
+    int y1 = std::min(top + spans.height, dst.height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    for (int row = y0; row < y1; row++) {
+        int srcRowIndex = row - top;
+        const uint32_t *srcRow = src + static_cast<size_t>(srcRowIndex) * srcStride;
+        uint32_t *dstRow = dst.pixels + static_cast<size_t>(row) * dst.stride;
+
+        for (uint32_t i = spans.rowStarts[srcRowIndex]; i < spans.rowStarts[srcRowIndex + 1]; i++) {
+            const AlphaSpan &span = spans.spans[i];
+            // Surface columns the span lands on; mirrored, source column c goes to left + width - 1 - c
+            int start = mirror ? left + spans.width - span.start - span.length : left + span.start;
+            int d0 = std::max(start, x0);
+            int d1 = std::min(start + span.length, x1);
+            if (d0 >= d1) continue;
+
+            int count = d1 - d0;
+            if (!mirror) {
+                const uint32_t *s = srcRow + (d0 - left);
+                if (span.opaque) std::memcpy(dstRow + d0, s, count * sizeof(uint32_t));
+                else blendRow(dstRow + d0, s, count);
+            } else {
+                // Leftmost source pixel of the run is the one that lands on d1 - 1
+                const uint32_t *s = srcRow + (spans.width - 1 - (d1 - 1 - left));
+                // No reversing memcpy; the mirrored kernels already store opaque blocks straight through
+                blendRowMirrored(dstRow + d0, s, count);
+            }
+        }
+    }
+}
+
+void ClearSurface(Surface &dst)
+{
+    if (dst.stride == dst.width) {
+        std::memset(dst.pixels, 0, static_cast<size_t>(dst.width) * dst.height * sizeof(uint32_t));
+        return;
+    }
+    for (int row = 0; row < dst.height; row++) {
+        std::memset(dst.pixels + static_cast<size_t>(row) * dst.stride, 0, dst.width * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Software compositing of premultiplied BGRA frames (0xAARRGGBB in memory order B, G, R, A).
+// Doesn't depend on any windowing API so it can be used and profiled anywhere.
+
+// A 32-bit premultiplied BGRA buffer to composite into
+struct Surface
+{
+    uint32_t *pixels = nullptr;
+    int width = 0, height = 0;
+    int stride = 0;               // In pixels
+    int originX = 0, originY = 0; // Screen position of pixel (0, 0)
+};
+
+enum class BlitPath { Scalar, SSE2, AVX2 };
+
+// Best kernel the CPU supports, picked once at startup
+BlitPath GetBlitPath();
+// Overrides the runtime choice (e.g. to compare kernels); falls back to Scalar if unsupported
+void SetBlitPath(BlitPath path);
+const char *GetBlitPathName(BlitPath path);
+
+// dst = src + dst * (255 - srcAlpha) / 255 for count pixels
+void BlendRow(uint32_t *dst, const uint32_t *src, int count);
+void BlendRowScalar(uint32_t *dst, const uint32_t *src, int count);
+// Same, reading src right to left: dst[i] is blended with src[count - 1 - i]
+void BlendRowMirrored(uint32_t *dst, const uint32_t *src, int count);
+
+// Blends a premultiplied image over the surface with its top-left at screen position (x, y), clipped to the surface.
+// mirror flips it horizontally while blending, so flipped frames need no extra memory.
+void BlendImage(Surface &dst, int x, int y, const uint32_t *src, int srcWidth, int srcHeight, int srcStride,
+                bool mirror = false);
+
+// A run of non-transparent pixels within one row of an image
+struct AlphaSpan
+{
+    uint16_t start = 0, length = 0;
+    bool opaque = false; // All alpha 255, so it can be copied instead of blended
+};
+
+// Per-row span lists of an image, built once when a frame is baked. Fully transparent
+// runs aren't stored at all, drawing just skips them.
+struct AlphaSpans
+{
+    int width = 0, height = 0;
+    std::vector<AlphaSpan> spans;
+    std::vector<uint32_t> rowStarts; // Row r's spans are spans[rowStarts[r]] up to spans[rowStarts[r + 1]]
+    size_t copiedPixels = 0;         // Covered by opaque spans
+    size_t blendedPixels = 0;        // Covered by partial spans
+
+    bool Empty() const { return rowStarts.empty(); }
+    size_t Bytes() const { return spans.size() * sizeof(AlphaSpan) + rowStarts.size() * sizeof(uint32_t); }
+};
+
+void EncodeAlphaSpans(const uint32_t *src, int width, int height, int stride, AlphaSpans &out);
+
+// Same as BlendImage, but only touches the pixels the spans cover: opaque runs are copied (memcpy unless mirrored),
+// partial ones blended
+void BlendImageSpans(Surface &dst, int x, int y, const uint32_t *src, int srcStride, const AlphaSpans &spans,
+                     bool mirror = false);
+
+void ClearSurface(Surface &dst);
@@ -0,0 +1,12 @@
+#include "clock.h"
+#include <chrono>
+
+uint64_t SteadyClock::NowNs() const {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+const Clock &SystemClock() {
+    static SteadyClock clock;
+    return clock;
+}
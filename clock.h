@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+
+// Where the simulation reads the time from, so it can run against the real clock or a fake one.
+// Ticks are milliseconds in a wrapping 32-bit counter (like GetTickCount); everything that
+// compares them goes through differences, so the wrap every ~49.7 days is harmless.
+class Clock
+{
+public:
+    virtual ~Clock() = default;
+
+    virtual uint64_t NowNs() const = 0; // Monotonic nanoseconds, arbitrary epoch
+    uint32_t NowMs() const { return static_cast<uint32_t>(NowNs() / 1000000); }
+};
+
+// The real monotonic clock (steady_clock, i.e. QueryPerformanceCounter on Windows)
+class SteadyClock : public Clock
+{
+public:
+    uint64_t NowNs() const override;
+};
+
+// Only moves when told to, for headless simulation and reproducible runs
+class ManualClock : public Clock
+{
+public:
+    explicit ManualClock(uint64_t startNs = 0) : now(startNs) {}
+
+    uint64_t NowNs() const override { return now; }
+    void Set(uint64_t ns) { now = ns; }
+    void Advance(uint64_t ns) { now += ns; }
+    void AdvanceMs(uint32_t ms) { now += static_cast<uint64_t>(ms) * 1000000; }
+
+private:
+    uint64_t now;
+};
+
+// Shared SteadyClock instance, the default for everything
+const Clock &SystemClock();
@@ -0,0 +1,99 @@
+#pragma once
+#include "sprite.h"
+
+// The path Sprite::LoadStateTables sets up for a state machine compiled into the program by smc --header.
+// Tables is the struct smc generates: the same records StateMachine loads, as constexpr std::arrays.
+// With every state's groups known at compile time, CheckTransition unrolls into a switch over the states,
+// each testing its conditions inline in order, with no condition dispatch or table walking left.
+//
+// TestCondition is also what the runtime path's EvaluateCondition switches to, so both test alike.
+
+template <Condition C>
+bool Sprite::TestCondition(const ConditionGroup& group) {
+  if constexpr (C == Condition::AtEndOfScreen) {
+    return posX + width >= worldLeft + screenWidth;
+  } else if constexpr (C == Condition::AtStartOfScreen) {
+    return posX <= worldLeft;
+  } else if constexpr (C == Condition::RandomInterval || C == Condition::SetInterval) {
+    // Armed in ArmTimedTransitions, set once its timer expired
+    for (int i = group.first; i < group.first + group.count; i++) {
+      if (timerExpired[i]) return true;
+    }
+    return false;
+  } else if constexpr (C == Condition::OnClick) {
+    bool wasClicked = clicked;
+    clicked = false;
+    return wasClicked;
+  } else {
+    static_assert(C == Condition::AnimationEnd, "Expression and Plugin conditions have their own Evaluate");
+    return animationEnded;
+  }
+}
+
+template <typename Tables>
+bool Sprite::LoadStateTables() {
+  for (const AnimationSource& animation : Tables::animations) {
+    LoadAnimation(animation, Tables::animationFrames.data() + animation.firstFrame);
+  }
+  ResolveMirroredAnimations();
+
+  StopStateMachine();
+  machine.LoadTables<Tables>();
+  checkTransition = &Sprite::CheckTransitionCompiled<Tables>;
+  return StartStateMachine();
+}
+
+template <typename Tables>
+void Sprite::CheckTransitionCompiled() {
+  uint8_t raised = pendingEvents;
+  pendingEvents = 0;
+
+  for (int r = 0; r < static_cast<int>(activeStates.size()); r++) {
+    if (activeStates[r] < 0) continue;
+    CheckStateCompiled<Tables>(r, activeStates[r], raised, std::make_integer_sequence<int, static_cast<int>(Tables::states.size())>());
+  }
+}
+
+template <typename Tables, int... S>
+void Sprite::CheckStateCompiled(int region, int current, uint8_t raised, std::integer_sequence<int, S...>) {
+  // One case per state
+  (void)((current == S && (CheckGroupsCompiled<Tables, S>(region, raised, std::make_integer_sequence<int, Tables::states[S].groupCount>()), true)) || ...);
+}
+
+template <typename Tables, int S, int... G>
+void Sprite::CheckGroupsCompiled(int region, uint8_t raised, std::integer_sequence<int, G...>) {
+  // Only conditions whose inputs changed since the last check can have a different outcome. The masks come
+  // from machine, where StartStateMachine updated those of plugin conditions.
+  uint8_t events = raised & machine.states[S].events;
+  if (!events) return;
+  // In order, up to the first whose condition holds
+  (void)(CheckGroupCompiled<Tables, Tables::states[S].firstGroup + G>(region, S, events) || ...);
+}
+
+template <typename Tables, int G>
+bool Sprite::CheckGroupCompiled(int region, int current, uint8_t events) {
+  constexpr ConditionGroup group = Tables::groups[G];
+  if constexpr (group.condition == Condition::Plugin) {
+    if (!(machine.groups[G].events & events)) return false;
+  } else {
+    if (!(group.events & events)) return false;
+  }
+  if constexpr (group.condition == Condition::Expression) {
+    if (!EvaluateExpression(Tables::expressionCode.data(), Tables::expressionConstants.data(), Tables::expressions[group.expression], region)) return false;
+  } else if constexpr (group.condition == Condition::Plugin) {
+    if (!EvaluatePlugin(group.plugin, region)) return false;
+  } else {
+    if (!TestCondition<group.condition>(group)) return false;
+  }
+
+  // Drawn even for a single target, so picks match the runtime path's
+  uint32_t columnBits = random(), coinBits = random();
+  int pick = group.first + SampleAliasTable(Tables::aliases.data() + group.first, group.count, columnBits, coinBits);
+  if (Tables::transitions[pick].to != current) {
+    EnterState(region, Tables::transitions[pick].to);
+  } else {
+    // Staying in the current state doesn't restart it, see CheckTransition
+    pendingEvents |= events;
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+// ABI for custom transition conditions, so they can live in a separate shared library (a .dll on
+// Windows, a .so elsewhere) built with any compiler. Plain C types only.
+//
+// A plugin exports
+//     CONDITION_PLUGIN_EXPORT int RegisterConditions(const ConditionHost *host);
+// which calls host->registerCondition once per condition and returns 0 on success. After that a
+// transition's "condition" can name any of them. See sampleConditions.cpp.
+#include <stdint.h>
+
+#ifdef __cplusplus
+#define CONDITION_PLUGIN_EXTERN extern "C"
+#else
+#define CONDITION_PLUGIN_EXTERN
+#endif
+#ifdef _WIN32
+#define CONDITION_PLUGIN_EXPORT CONDITION_PLUGIN_EXTERN __declspec(dllexport)
+#else
+#define CONDITION_PLUGIN_EXPORT CONDITION_PLUGIN_EXTERN __attribute__((visibility("default")))
+#endif
+
+#define CONDITION_PLUGIN_VERSION 1
+#define CONDITION_PLUGIN_ENTRY "RegisterConditions"
+
+// What a condition can read, refreshed before every call
+typedef struct ConditionInputs
+{
+    float x, y, width, height;         // The sprite
+    float left, top, screenW, screenH; // The world it walks in
+    float vx, vy;                      // Pixels per second
+    float elapsed;                     // Milliseconds in the current state
+    int32_t animationEnded;            // 1 once the animation played through
+} ConditionInputs;
+
+// Nonzero if the condition holds. userData is what it was registered with.
+typedef int (*ConditionFunction)(const ConditionInputs *inputs, void *userData);
+
+// What can change a condition's outcome (EVENT_* in stateMachine.h); a condition is only asked
+// again after one of them happened. 0 means every step.
+#define CONDITION_EVENT_INPUT 1
+#define CONDITION_EVENT_POSITION 2
+#define CONDITION_EVENT_TIME 4
+#define CONDITION_EVENT_ANIMATION_END 8
+#define CONDITION_EVENT_STEP 16
+#define CONDITION_EVENT_STATE 32
+
+typedef struct ConditionHost
+{
+    uint32_t version; // CONDITION_PLUGIN_VERSION
+    void *registry;
+    int (*registerCondition)(void *registry, const char *name, ConditionFunction function, uint8_t events, void *userData);
+} ConditionHost;
+
+typedef int (*RegisterConditionsFunction)(const ConditionHost *host);
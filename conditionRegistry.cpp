@@ -0,0 +1,93 @@
+#include "conditionRegistry.h"
+#include <iostream>
+#include <filesystem>
+#include "stateMachine.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+namespace fs = std::filesystem;
+
+static_assert(CONDITION_EVENT_INPUT == EVENT_INPUT && CONDITION_EVENT_POSITION == EVENT_POSITION &&
+              CONDITION_EVENT_TIME == EVENT_TIME && CONDITION_EVENT_ANIMATION_END == EVENT_ANIMATION_END &&
+              CONDITION_EVENT_STEP == EVENT_STEP && CONDITION_EVENT_STATE == EVENT_STATE, "plugin ABI events");
+
+namespace {
+
+int RegisterFromPlugin(void *registry, const char *name, ConditionFunction function, uint8_t events, void *userData) {
+    if (!name || !function) return 1;
+    return static_cast<ConditionRegistry *>(registry)->Register(name, function, events, userData) ? 0 : 1;
+}
+
+}
+
+bool ConditionRegistry::Register(const std::string &name, ConditionFunction function, uint8_t events, void *userData) {
+    if (entries.count(name)) {
+        std::cerr << "Condition " << name << " is already registered" << std::endl;
+        return false;
+    }
+    Entry &entry = entries[name];
+    entry.function = function;
+    entry.events = events ? events : EVENT_ALL;
+    entry.userData = userData;
+    return true;
+}
+
+const ConditionRegistry::Entry *ConditionRegistry::Find(const std::string &name) const {
+    auto entryIt = entries.find(name);
+    return entryIt != entries.end() ? &entryIt->second : nullptr;
+}
+
+bool ConditionRegistry::LoadPlugin(const std::string &path) {
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(path.c_str());
+    if (!library) {
+        std::cerr << "Failed to load plugin " << path << std::endl;
+        return false;
+    }
+    auto registerConditions = reinterpret_cast<RegisterConditionsFunction>(GetProcAddress(library, CONDITION_PLUGIN_ENTRY));
+#else
+    void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        std::cerr << "Failed to load plugin " << path << ": " << dlerror() << std::endl;
+        return false;
+    }
+    auto registerConditions = reinterpret_cast<RegisterConditionsFunction>(dlsym(library, CONDITION_PLUGIN_ENTRY));
+#endif
+    // Never unloaded, the registered functions live in it
+    libraries.push_back(library);
+    if (!registerConditions) {
+        std::cerr << "Plugin " << path << " has no " << CONDITION_PLUGIN_ENTRY << std::endl;
+        return false;
+    }
+
+    ConditionHost host;
+    host.version = CONDITION_PLUGIN_VERSION;
+    host.registry = this;
+    host.registerCondition = RegisterFromPlugin;
+    if (registerConditions(&host) != 0) {
+        std::cerr << "Plugin " << path << " failed to register its conditions" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int ConditionRegistry::LoadPlugins(const std::string &folder) {
+#ifdef _WIN32
+    const char *extension = ".dll";
+#else
+    const char *extension = ".so";
+#endif
+    int loaded = 0;
+    std::error_code error;
+    for (const auto &entry : fs::directory_iterator(folder, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == extension && LoadPlugin(entry.path().string())) loaded++;
+    }
+    return loaded;
+}
+
+ConditionRegistry &ConditionRegistry::Global() {
+    static ConditionRegistry registry;
+    return registry;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "conditionPlugin.h"
+
+// Transition conditions beyond the built-in ones, by name: registered from code or loaded from
+// plugins (see conditionPlugin.h). The state machine resolves names once when it's loaded, so
+// testing one on a step is a single indirect call.
+class ConditionRegistry
+{
+public:
+    struct Entry
+    {
+        ConditionFunction function = nullptr;
+        uint8_t events = 0; // EVENT_* (see stateMachine.h)
+        void *userData = nullptr;
+    };
+
+    // False (and reported) if the name is already registered. Built-in condition names always mean
+    // the built-in condition.
+    bool Register(const std::string &name, ConditionFunction function, uint8_t events, void *userData = nullptr);
+    // Null if nothing is registered under name
+    const Entry *Find(const std::string &name) const;
+    size_t GetCount() const { return entries.size(); }
+
+    // Opens a shared library and calls its RegisterConditions; it stays loaded for good.
+    // False, reported on std::cerr, if it can't be opened or registering failed.
+    bool LoadPlugin(const std::string &path);
+    // Every .dll (Windows) or .so (elsewhere) in folder; returns how many loaded. A missing folder is fine.
+    int LoadPlugins(const std::string &folder);
+
+    // The one Sprite and smc use
+    static ConditionRegistry &Global();
+
+private:
+    std::map<std::string, Entry> entries;
+    std::vector<void *> libraries;
+};
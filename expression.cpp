@@ -0,0 +1,381 @@
+#include "expression.h"
+#include "stateMachine.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct VariableName
+{
+    const char *name;
+    ExpressionVariable variable;
+    uint8_t events; // What changes it
+};
+
+const VariableName VARIABLES[] = {
+    { "x", ExpressionVariable::X, EVENT_POSITION },
+    { "y", ExpressionVariable::Y, EVENT_POSITION },
+    { "width", ExpressionVariable::Width, EVENT_POSITION },
+    { "height", ExpressionVariable::Height, EVENT_POSITION },
+    { "left", ExpressionVariable::Left, EVENT_POSITION },
+    { "top", ExpressionVariable::Top, EVENT_POSITION },
+    { "screenW", ExpressionVariable::ScreenW, EVENT_POSITION },
+    { "screenH", ExpressionVariable::ScreenH, EVENT_POSITION },
+    { "vx", ExpressionVariable::VX, EVENT_STATE },  // Only changes when a state with an animation is entered
+    { "vy", ExpressionVariable::VY, EVENT_STATE },
+    { "elapsed", ExpressionVariable::Elapsed, EVENT_STEP },
+    { "animationEnd", ExpressionVariable::AnimationEnd, EVENT_ANIMATION_END },
+};
+
+// Recursive descent, one function per precedence level. Each compiles its operand into register
+// reg, using the registers above it for temporaries.
+class Parser
+{
+public:
+    Parser(const std::string &text, std::vector<ExpressionInstruction> &code, std::vector<float> &constants, const ExpressionStates *states)
+        : text(text), code(code), constants(constants), states(states), firstInstruction(code.size()), firstConstant(constants.size()) {}
+
+    bool Parse(ExpressionProgram &program, std::string &error) {
+        bool ok = Or(0);
+        SkipSpace();
+        if (ok && position < text.size()) ok = Fail("unexpected '" + text.substr(position, 1) + "'");
+        if (!ok) {
+            error = message + " at column " + std::to_string(position + 1) + " of \"" + text + "\"";
+            code.resize(firstInstruction);
+            constants.resize(firstConstant);
+            return false;
+        }
+        program.firstInstruction = static_cast<int32_t>(firstInstruction);
+        program.instructionCount = static_cast<int32_t>(code.size() - firstInstruction);
+        program.firstConstant = static_cast<int32_t>(firstConstant);
+        program.constantCount = static_cast<int32_t>(constants.size() - firstConstant);
+        // One that reads nothing that changes (e.g. "1") still has to be tested when its state is entered
+        program.events = events ? events : EVENT_STATE;
+        return true;
+    }
+
+private:
+    const std::string &text;
+    std::vector<ExpressionInstruction> &code;
+    std::vector<float> &constants;
+    const ExpressionStates *states;
+    size_t firstInstruction, firstConstant;
+    size_t position = 0;
+    uint8_t events = 0;
+    std::string message;
+
+    bool Fail(const std::string &what) {
+        if (message.empty()) message = what;
+        return false;
+    }
+
+    void SkipSpace() {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) position++;
+    }
+
+    bool Match(const char *token) {
+        SkipSpace();
+        size_t length = std::strlen(token);
+        if (text.compare(position, length, token) != 0) return false;
+        // "<" isn't the start of "<=", nor "!" of "!="
+        if (length == 1 && position + 1 < text.size() && text[position + 1] == '=' && std::strchr("<>!=", token[0])) return false;
+        position += length;
+        return true;
+    }
+
+    size_t Emit(ExpressionOp op, int dst, int a = 0, int b = 0, uint32_t operand = 0) {
+        code.push_back({ op, static_cast<uint8_t>(dst), static_cast<uint8_t>(a), static_cast<uint8_t>(b), operand });
+        return code.size() - 1;
+    }
+
+    // Jumps are relative to the start of the program, so it can be moved around as a whole
+    void PatchJump(size_t jump) {
+        code[jump].operand = static_cast<uint32_t>(code.size() - firstInstruction);
+    }
+
+    bool Binary(ExpressionOp op, int reg, bool (Parser::*operand)(int)) {
+        if (!(this->*operand)(reg + 1)) return false;
+        Emit(op, reg, reg, reg + 1);
+        return true;
+    }
+
+    bool Or(int reg) {
+        if (!And(reg)) return false;
+        while (Match("||")) {
+            Emit(ExpressionOp::Truth, reg, reg);
+            size_t jump = Emit(ExpressionOp::JumpIfTrue, reg);
+            if (!And(reg)) return false;
+            Emit(ExpressionOp::Truth, reg, reg);
+            PatchJump(jump);
+        }
+        return true;
+    }
+
+    bool And(int reg) {
+        if (!Comparison(reg)) return false;
+        while (Match("&&")) {
+            Emit(ExpressionOp::Truth, reg, reg);
+            size_t jump = Emit(ExpressionOp::JumpIfFalse, reg);
+            if (!Comparison(reg)) return false;
+            Emit(ExpressionOp::Truth, reg, reg);
+            PatchJump(jump);
+        }
+        return true;
+    }
+
+    bool Comparison(int reg) {
+        if (!Sum(reg)) return false;
+        for (;;) {
+            if (Match("<=")) {
+                if (!Binary(ExpressionOp::LessEqual, reg, &Parser::Sum)) return false;
+            } else if (Match(">=")) {
+                if (!Binary(ExpressionOp::GreaterEqual, reg, &Parser::Sum)) return false;
+            } else if (Match("==")) {
+                if (!Binary(ExpressionOp::Equal, reg, &Parser::Sum)) return false;
+            } else if (Match("!=")) {
+                if (!Binary(ExpressionOp::NotEqual, reg, &Parser::Sum)) return false;
+            } else if (Match("<")) {
+                if (!Binary(ExpressionOp::Less, reg, &Parser::Sum)) return false;
+            } else if (Match(">")) {
+                if (!Binary(ExpressionOp::Greater, reg, &Parser::Sum)) return false;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool Sum(int reg) {
+        if (!Product(reg)) return false;
+        for (;;) {
+            if (Match("+")) {
+                if (!Binary(ExpressionOp::Add, reg, &Parser::Product)) return false;
+            } else if (Match("-")) {
+                if (!Binary(ExpressionOp::Subtract, reg, &Parser::Product)) return false;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool Product(int reg) {
+        if (!Unary(reg)) return false;
+        for (;;) {
+            if (Match("*")) {
+                if (!Binary(ExpressionOp::Multiply, reg, &Parser::Unary)) return false;
+            } else if (Match("/")) {
+                if (!Binary(ExpressionOp::Divide, reg, &Parser::Unary)) return false;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool Unary(int reg) {
+        if (reg >= EXPRESSION_REGISTERS) return Fail("too deeply nested");
+        if (Match("!")) {
+            if (!Unary(reg)) return false;
+            Emit(ExpressionOp::Not, reg, reg);
+            return true;
+        }
+        if (Match("-")) {
+            if (!Unary(reg)) return false;
+            Emit(ExpressionOp::Negate, reg, reg);
+            return true;
+        }
+        return Primary(reg);
+    }
+
+    bool Primary(int reg) {
+        SkipSpace();
+        if (Match("(")) {
+            if (!Or(reg)) return false;
+            return Match(")") || Fail("missing ')'");
+        }
+        if (position >= text.size()) return Fail("unexpected end");
+
+        char c = text[position];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            // Decimal only: strtof alone would also take hex ("0x10") and hex floats
+            size_t start = position, digits = 0;
+            auto skipDigits = [&]() {
+                while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position]))) {
+                    position++;
+                    digits++;
+                }
+            };
+            skipDigits();
+            if (position < text.size() && text[position] == '.') {
+                position++;
+                skipDigits();
+            }
+            if (digits == 0) return Fail("bad number");
+            if (position < text.size() && (text[position] == 'e' || text[position] == 'E')) {
+                size_t exponent = position++;
+                if (position < text.size() && (text[position] == '+' || text[position] == '-')) position++;
+                digits = 0;
+                skipDigits();
+                if (digits == 0) {
+                    position = exponent;
+                    return Fail("bad number");
+                }
+            }
+            if (position < text.size() && std::isalpha(static_cast<unsigned char>(text[position]))) return Fail("bad number");
+            float value = std::strtof(text.substr(start, position - start).c_str(), nullptr);
+            Emit(ExpressionOp::Constant, reg, 0, 0, AddConstant(value));
+            return true;
+        }
+
+        if (!std::isalpha(static_cast<unsigned char>(c))) return Fail("unexpected '" + std::string(1, c) + "'");
+        size_t start = position;
+        while (position < text.size() && std::isalnum(static_cast<unsigned char>(text[position]))) position++;
+        std::string name = text.substr(start, position - start);
+
+        bool call = Match("(");
+        if (call && name == "in") {
+            SkipSpace();
+            size_t argument = position;
+            while (position < text.size() && (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_')) position++;
+            std::string stateName = text.substr(argument, position - argument);
+            auto stateIt = states ? states->find(stateName) : ExpressionStates::const_iterator();
+            if (!states || stateIt == states->end()) {
+                position = argument;
+                return Fail("unknown state '" + stateName + "'");
+            }
+            if (!Match(")")) return Fail("missing ')'");
+            // Range as two adjacent constants, exact in a float up to 2^24 states
+            uint32_t range = static_cast<uint32_t>(constants.size() - firstConstant);
+            constants.push_back(static_cast<float>(stateIt->second.first));
+            constants.push_back(static_cast<float>(stateIt->second.second));
+            Emit(ExpressionOp::InState, reg, 0, 0, range);
+            events |= EVENT_STATE;
+            return true;
+        }
+        if (call) {
+            if (!Match(")")) return Fail(name + "() takes no arguments");
+            if (name == "rand") {
+                Emit(ExpressionOp::Rand, reg);
+                events |= EVENT_STEP; // A new roll every step
+            } else if (name == "clicked") {
+                Emit(ExpressionOp::Clicked, reg);
+                events |= EVENT_INPUT;
+            } else {
+                position = start;
+                return Fail("unknown function " + name);
+            }
+            return true;
+        }
+
+        for (const auto &variable : VARIABLES) {
+            if (name == variable.name) {
+                Emit(ExpressionOp::Variable, reg, static_cast<int>(variable.variable));
+                events |= variable.events;
+                return true;
+            }
+        }
+        position = start;
+        return Fail("unknown variable " + name);
+    }
+
+    uint32_t AddConstant(float value) {
+        for (size_t i = firstConstant; i < constants.size(); i++) {
+            if (constants[i] == value) return static_cast<uint32_t>(i - firstConstant);
+        }
+        constants.push_back(value);
+        return static_cast<uint32_t>(constants.size() - 1 - firstConstant);
+    }
+};
+
+}
+
+bool CompileExpression(const std::string &text, std::vector<ExpressionInstruction> &code, std::vector<float> &constants,
+                       ExpressionProgram &program, std::string &error, const ExpressionStates *states) {
+    return Parser(text, code, constants, states).Parse(program, error);
+}
+
+bool CheckExpression(const ExpressionProgram &program, const std::vector<ExpressionInstruction> &code, size_t constantCount) {
+    if (program.firstInstruction < 0 || program.instructionCount <= 0 ||
+        static_cast<size_t>(program.firstInstruction) + program.instructionCount > code.size() ||
+        program.firstConstant < 0 || program.constantCount < 0 ||
+        static_cast<size_t>(program.firstConstant) + program.constantCount > constantCount) {
+        return false;
+    }
+
+    for (int pc = 0; pc < program.instructionCount; pc++) {
+        const ExpressionInstruction &instruction = code[program.firstInstruction + pc];
+        if (instruction.op > ExpressionOp::JumpIfTrue || instruction.dst >= EXPRESSION_REGISTERS ||
+            instruction.a >= EXPRESSION_REGISTERS || instruction.b >= EXPRESSION_REGISTERS) {
+            return false;
+        }
+        switch (instruction.op) {
+        case ExpressionOp::Constant:
+            if (instruction.operand >= static_cast<uint32_t>(program.constantCount)) return false;
+            break;
+        case ExpressionOp::InState:
+            if (instruction.operand + 1 >= static_cast<uint32_t>(program.constantCount)) return false;
+            break;
+        case ExpressionOp::Variable:
+            if (instruction.a >= static_cast<int>(ExpressionVariable::Count)) return false;
+            break;
+        case ExpressionOp::JumpIfFalse:
+        case ExpressionOp::JumpIfTrue:
+            // Only forwards, so every program ends
+            if (instruction.operand <= static_cast<uint32_t>(pc) || instruction.operand > static_cast<uint32_t>(program.instructionCount)) return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool RunExpression(const ExpressionInstruction *code, const float *constants, const ExpressionProgram &program,
+                   ExpressionContext &context) {
+    float r[EXPRESSION_REGISTERS] = {};
+    const ExpressionInstruction *begin = code + program.firstInstruction;
+    const float *programConstants = constants + program.firstConstant;
+
+    for (int pc = 0; pc < program.instructionCount; pc++) {
+        const ExpressionInstruction &instruction = begin[pc];
+        float &dst = r[instruction.dst];
+        float a = r[instruction.a], b = r[instruction.b];
+        switch (instruction.op) {
+        case ExpressionOp::Constant: dst = programConstants[instruction.operand]; break;
+        case ExpressionOp::Variable: dst = context.variables[instruction.a]; break;
+        case ExpressionOp::Rand: dst = ((*context.random)() >> 8) * (1.0f / 16777216.0f); break;
+        case ExpressionOp::Clicked:
+            dst = *context.clicked ? 1.0f : 0.0f;
+            *context.clicked = false;
+            break;
+        case ExpressionOp::InState: {
+            int32_t first = static_cast<int32_t>(programConstants[instruction.operand]);
+            int32_t count = static_cast<int32_t>(programConstants[instruction.operand + 1]);
+            dst = 0.0f;
+            for (int i = 0; i < context.activeStateCount; i++) {
+                if (context.activeStates[i] - first >= 0 && context.activeStates[i] - first < count) dst = 1.0f;
+            }
+            break;
+        }
+        case ExpressionOp::Add: dst = a + b; break;
+        case ExpressionOp::Subtract: dst = a - b; break;
+        case ExpressionOp::Multiply: dst = a * b; break;
+        case ExpressionOp::Divide: dst = a / b; break;
+        case ExpressionOp::Less: dst = a < b; break;
+        case ExpressionOp::LessEqual: dst = a <= b; break;
+        case ExpressionOp::Greater: dst = a > b; break;
+        case ExpressionOp::GreaterEqual: dst = a >= b; break;
+        case ExpressionOp::Equal: dst = a == b; break;
+        case ExpressionOp::NotEqual: dst = a != b; break;
+        case ExpressionOp::Negate: dst = -a; break;
+        case ExpressionOp::Not: dst = a == 0; break;
+        case ExpressionOp::Truth: dst = a != 0; break;
+        case ExpressionOp::JumpIfFalse:
+            if (dst == 0) pc = static_cast<int>(instruction.operand) - 1;
+            break;
+        case ExpressionOp::JumpIfTrue:
+            if (dst != 0) pc = static_cast<int>(instruction.operand) - 1;
+            break;
+        }
+    }
+    return r[0] != 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <random>
+#include <map>
+
+// Transition conditions written as expressions, e.g. "x > screenW * 0.8 && elapsed > 400 && rand() < 0.3".
+// They're compiled once into register bytecode; running one only touches a fixed array of registers.
+//
+// Numbers are floats written in decimal (12, 0.5, .5, 1e3; not hex, inf or nan), comparisons and ! give 1 or 0, && and || stop at the first operand that decides
+// them, and an expression holds when its value isn't 0.
+// Variables: x y (position), width height, left top screenW screenH (the world), vx vy (velocity),
+// elapsed (ms in the current state), animationEnd (1 once its animation played through).
+// Functions: rand() (uniform in [0, 1)), clicked() (1 if clicked since it was last asked, like onClick),
+// in(state) (1 if some region is in that state, or in one nested inside it).
+
+enum class ExpressionVariable : uint8_t { X, Y, Width, Height, Left, Top, ScreenW, ScreenH, VX, VY, Elapsed, AnimationEnd, Count };
+
+enum class ExpressionOp : uint8_t
+{
+    Constant,    // r[dst] = constants[operand]
+    Variable,    // r[dst] = variables[a]
+    Rand,        // r[dst] = rand()
+    Clicked,     // r[dst] = clicked()
+    InState,     // r[dst] = in(the states numbered constants[operand], counting constants[operand + 1])
+    Add, Subtract, Multiply, Divide,
+    Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, // r[dst] = r[a] op r[b]
+    Negate,      // r[dst] = -r[a]
+    Not,         // r[dst] = !r[a]
+    Truth,       // r[dst] = r[a] != 0
+    JumpIfFalse, // if r[dst] == 0, continue at operand
+    JumpIfTrue,  // if r[dst] != 0, continue at operand
+};
+
+struct ExpressionInstruction
+{
+    ExpressionOp op;
+    uint8_t dst;
+    uint8_t a, b;      // Source registers, or the variable
+    uint32_t operand;  // Constant index or jump target
+};
+
+// One compiled expression: a range of instructions and of constants, result in register 0
+struct ExpressionProgram
+{
+    int32_t firstInstruction = 0, instructionCount = 0;
+    int32_t firstConstant = 0, constantCount = 0;
+    uint8_t events = 0;  // EVENT_* (see stateMachine.h) of what it reads
+    uint8_t unused[3] = {};
+};
+
+// What an expression can read while it runs
+struct ExpressionContext
+{
+    float variables[static_cast<int>(ExpressionVariable::Count)] = {};
+    std::mt19937 *random = nullptr;
+    bool *clicked = nullptr;
+    const int32_t *activeStates = nullptr; // The state of every region
+    int activeStateCount = 0;
+};
+
+// State name -> the range of states in() it covers
+using ExpressionStates = std::map<std::string, std::pair<int32_t, int32_t>>;
+
+const int EXPRESSION_REGISTERS = 16;
+
+// Compiles text, appending to code and constants. On a syntax error returns false and
+// describes it in error; code and constants are left as they were. states is what in() can name.
+bool CompileExpression(const std::string &text, std::vector<ExpressionInstruction> &code, std::vector<float> &constants,
+                       ExpressionProgram &program, std::string &error, const ExpressionStates *states = nullptr);
+
+// False if program reaches outside code or constants, or has an operand out of range (for loaded bytecode)
+bool CheckExpression(const ExpressionProgram &program, const std::vector<ExpressionInstruction> &code, size_t constantCount);
+
+bool RunExpression(const ExpressionInstruction *code, const float *constants, const ExpressionProgram &program,
+                   ExpressionContext &context);
@@ -0,0 +1,133 @@
+// Frame loop benchmark for the Windows build: draws and presents the sprite the way RedrawSprite used to,
+// creating the screen DC, memory DC, DIB section and GDI+ Graphics for every frame and deleting them after,
+// and the way it does now, through a RenderTarget that keeps them. Prints the time per frame and how many
+// DIB sections each way allocated per frame. Build with `nmake frameBench.exe`, run from the repo root:
+//   frameBench.exe [frames] [WxH]
+// The size defaults to the primary screen. Frames are presented to a layered window that's never shown.
+#include <windows.h>
+#include <gdiplus.h>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include "sprite.h"
+#include "renderTarget.h"
+
+#pragma comment(lib, "user32.lib")
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "gdiplus.lib")
+
+namespace {
+
+int newDibAllocations = 0; // DIB sections PresentWithNewDib created
+
+// Blends the sprite into a DIB's bits with the software blitter, like PresentOverlay
+void DrawInto(Sprite &sprite, void *bits, int width, int height) {
+    Surface surface;
+    surface.pixels = static_cast<uint32_t*>(bits);
+    surface.width = surface.stride = width;
+    surface.height = height;
+    GdiFlush();
+    SurfaceRenderer renderer(surface);
+    renderer.Clear();
+    sprite.Draw(renderer);
+}
+
+// What RedrawSprite did before RenderTarget: everything created and deleted every frame
+void PresentWithNewDib(Sprite &sprite, HWND hwnd, int width, int height) {
+    HDC hdcScreen = GetDC(nullptr);
+    HDC hdcMem = CreateCompatibleDC(hdcScreen);
+
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void* bits = nullptr;
+    HBITMAP hBitmap = CreateDIBSection(hdcMem, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+    if (hBitmap) newDibAllocations++;
+    HGDIOBJ oldBitmap = SelectObject(hdcMem, hBitmap);
+    {
+        Gdiplus::Graphics graphics(hdcMem);
+        DrawInto(sprite, bits, width, height);
+
+        SIZE wndSize = { width, height };
+        POINT srcPt = { 0, 0 };
+        POINT ptDst = { 0, 0 };
+        BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+        UpdateLayeredWindow(hwnd, hdcScreen, &ptDst, &wndSize, hdcMem, &srcPt, 0, &blend, ULW_ALPHA);
+    }
+    SelectObject(hdcMem, oldBitmap);
+    DeleteObject(hBitmap);
+    DeleteDC(hdcMem);
+    ReleaseDC(nullptr, hdcScreen);
+}
+
+void PresentWithRenderTarget(Sprite &sprite, RenderTarget &renderTarget, HWND hwnd, int width, int height) {
+    if (!renderTarget.Resize(width, height)) return; // Only reallocates when the size changed
+    DrawInto(sprite, renderTarget.GetBits(), width, height);
+    renderTarget.Present(hwnd, { 0, 0 });
+}
+
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+    int width = GetSystemMetrics(SM_CXSCREEN), height = GetSystemMetrics(SM_CYSCREEN);
+    if (argc > 2 && std::sscanf(argv[2], "%dx%d", &width, &height) != 2) {
+        std::cerr << "Usage: frameBench.exe [frames] [WxH]" << std::endl;
+        return 1;
+    }
+    if (frames <= 0 || width <= 0 || height <= 0) {
+        std::cerr << "Usage: frameBench.exe [frames] [WxH]" << std::endl;
+        return 1;
+    }
+
+    ULONG_PTR gdiplusToken;
+    Gdiplus::GdiplusStartupInput gdiPlusStartupInput;
+    Gdiplus::GdiplusStartup(&gdiplusToken, &gdiPlusStartupInput, nullptr);
+
+    WNDCLASSW wc = {};
+    wc.lpfnWndProc = DefWindowProc;
+    wc.hInstance = GetModuleHandleW(nullptr);
+    wc.lpszClassName = L"FrameBench";
+    RegisterClassW(&wc);
+    HWND hwnd = CreateWindowExW(WS_EX_LAYERED | WS_EX_TOOLWINDOW, L"FrameBench", L"", WS_POPUP,
+                                0, 0, width, height, nullptr, nullptr, wc.hInstance, nullptr);
+
+    std::cout << "Frame benchmark: " << frames << " frames each at " << width << "x" << height << std::endl;
+    {
+        RenderTarget renderTarget;
+        for (int kept = 0; kept < 2; kept++) {
+            ManualClock clock;
+            Sprite sprite(width, height, clock);
+            sprite.LoadAnimations("animations");
+            sprite.LoadStateMachine("stateMachine.json");
+            sprite.SetHeight(150);
+            sprite.SetPosition(static_cast<float>(width - 3 * sprite.GetWidth()), static_cast<float>(height - sprite.GetHeight() - 50));
+
+            auto start = std::chrono::steady_clock::now();
+            for (int n = 0; n < frames; n++) {
+                clock.AdvanceMs(Sprite::SIM_STEP_MS);
+                sprite.Update();
+                if (kept) {
+                    PresentWithRenderTarget(sprite, renderTarget, hwnd, width, height);
+                } else {
+                    PresentWithNewDib(sprite, hwnd, width, height);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double allocations = static_cast<double>(kept ? renderTarget.GetAllocationCount() : newDibAllocations) / frames;
+            std::cout << "  " << (kept ? "RenderTarget" : "DIB per frame") << ": " << seconds * 1e6 / frames
+                      << " us per frame, " << allocations << " DIB allocations per frame" << std::endl;
+        }
+    }
+
+    DestroyWindow(hwnd);
+    Gdiplus::GdiplusShutdown(gdiplusToken);
+    return 0;
+}
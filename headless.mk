@@ -0,0 +1,60 @@
+# GNU make build of the headless simulation (no Windows APIs), for Linux profiling and build farms.
+# Usage: make -f headless.mk        then run ./headless_sim from the repo root
+# Also builds smc, the state machine compiler (see smc.cpp), and with it stateTables.h, the state
+# machine compiled into headless_sim for --tables-bench. `make -f headless.mk sampleConditions.so` builds
+# the sample condition plugin (see conditionPlugin.h).
+# `make -f headless.mk test` builds and runs the tests in tests/ (each exits non-zero on failure).
+
+CXX ?= g++
+CXXFLAGS ?= -O2 -g -std=c++17 -Wall -I nlohmann
+LDLIBS = -ldl
+
+SRC = headless_sim.cpp benchmarks.cpp sprite.cpp aliasTable.cpp stateMachine.cpp expression.cpp conditionRegistry.cpp blitter.cpp renderer.cpp image.cpp atlas.cpp scheduler.cpp clock.cpp timerWheel.cpp monitorLayout.cpp png.cpp
+OBJ = $(SRC:.cpp=.o)
+OUT = headless_sim
+SMC_OBJ = smc.o stateMachine.o aliasTable.o expression.o conditionRegistry.o
+# stateTables.h is generated by smc, so only what includes it depends on it
+HEADERS = $(filter-out stateTables.h,$(wildcard *.h))
+TEST_OBJ = $(filter-out headless_sim.o benchmarks.o,$(OBJ))
+TESTS = tests/blitterTest tests/schedulerTest tests/timerWheelTest tests/stateMachineTest tests/monitorLayoutTest tests/expressionTest
+
+all: $(OUT) smc
+
+$(OUT): $(OBJ)
+	$(CXX) $(CXXFLAGS) -o $@ $(OBJ) $(LDFLAGS) $(LDLIBS)
+
+smc: $(SMC_OBJ)
+	$(CXX) $(CXXFLAGS) -o $@ $(SMC_OBJ) $(LDFLAGS) $(LDLIBS)
+
+sampleConditions.so: sampleConditions.cpp conditionPlugin.h
+	$(CXX) $(CXXFLAGS) -shared -fPIC -fvisibility=hidden -o $@ $<
+
+stateTables.h: stateMachine.json $(wildcard animations/*.json) smc
+	./smc --header stateMachine.json $@
+
+benchmarks.o: stateTables.h
+
+tests/%: tests/%.o $(TEST_OBJ)
+	$(CXX) $(CXXFLAGS) -o $@ $< $(TEST_OBJ) $(LDFLAGS) $(LDLIBS)
+
+tests/%.o: tests/%.cpp $(HEADERS)
+	$(CXX) $(CXXFLAGS) -I . -c $< -o $@
+
+test: $(TESTS) $(OUT)
+	./tests/blitterTest
+	./tests/schedulerTest
+	./tests/timerWheelTest
+	./tests/stateMachineTest
+	./tests/monitorLayoutTest
+	./tests/expressionTest
+	./tests/wrapTest.sh
+	./headless_sim --alias-bench 5
+	./headless_sim --alias-bench 300
+
+%.o: %.cpp $(HEADERS)
+	$(CXX) $(CXXFLAGS) -c $< -o $@
+
+clean:
+	rm -f $(OUT) $(OBJ) smc smc.o stateTables.h sampleConditions.so $(TESTS) $(TESTS:=.o)
+
+.PHONY: all clean test
@@ -0,0 +1,363 @@
+// Runs the sprite simulation and software renderer without any window, as fast as possible.
+// Meant for profiling (perf, valgrind) and build farms. Run from the repo root so the
+// animations/ and img/ paths resolve.
+//
+//   headless_sim [--ticks N] [--screen WxH] [--full-screen] [--blit scalar|sse2|avx2] [--dump out.ppm] [--scheduled]
+//              [--monitors WxH+X+Y,...] [--resampled] [--rect-blit]
+//              [--hit-bench N] [--start-ms T] [--tick-ms N] [--timer-bench N]
+//              [--no-render] [--alias-bench N] [--state-machine path] [--expr-bench N] [--tables-bench N]
+//              [--plugin path]... [--plugin-bench N] [--blit-bench N] [--check-bench N]
+//              [--events-bench N] [--load-bench N] [--hierarchy-bench D] [--frame-bench N]
+//
+// --scheduled drives the sprite from a simulated clock that jumps straight to each deadline
+// the TickScheduler picks, and reports how many wakeups per simulated second that needs.
+// Simulated runs are reproducible; --start-ms sets the simulated tick count they start at, e.g.
+// 4294960000 to run across the 32-bit wrap, which must not change the output.
+// --tick-ms sets how often a moving sprite is ticked; the simulation runs in fixed steps either way.
+// The --*-bench modes are in benchmarks.cpp.
+// --timer-bench runs N stand-in sprites with four timed transitions each for a simulated minute,
+// polling the elapsed time like EvaluateCondition used to vs. a timer wheel per sprite vs. one shared wheel.
+// --alias-bench draws from N weighted transition targets with an alias table vs. a linear scan and checks
+// the picks' distribution against the weights (exit code 1 if it's off).
+// --expr-bench evaluates transition conditions N times: the string-compare chain EvaluateCondition used to
+// be vs. "when" expressions run as bytecode.
+// --tables-bench steps a sprite N times with stateMachine.json loaded at runtime vs. compiled in by
+// smc --header (stateTables.h), and checks both end up in the same place (exit code 1 if not).
+// --plugin loads a condition plugin (see conditionPlugin.h) before the state machine, which can then use
+// its conditions. --plugin-bench registers 100 conditions and evaluates them N times: found by comparing
+// names like the old EvaluateCondition chain, looked up by name, and through the resolved function pointer.
+// --blit-bench blends the cat frame scaled to 150, 512 and 1024 pixels high N times with every blitter kernel the
+// CPU supports and reports Mpixels/s (whole frame rectangle, as BlendImage does, and only its alpha spans), not
+// counting the copy of a fresh background before each blit.
+// --check-bench checks walkRight's transitions mid-screen N times: with stateMachine.json kept keyed by name and
+// the conditions grouped and compared as strings on every check, like CheckTransition used to, vs. the flat tables.
+// --events-bench steps a sprite idling in a state with 300 transitions (timed ones that don't come due, onClick,
+// atEndOfScreen) N times: as it runs, re-checking only groups whose events were raised, vs. with every group
+// checked every step as before event masks.
+// --load-bench generates a state machine with N states of seven transitions each, writes it to the temp folder,
+// precompiles it as smc does, and reports load time and ns per step for both forms, checking they take the
+// same path (exit code 1 if not). --hierarchy-bench does the same with a machine nested D levels deep
+// (2^D innermost states), plus the same machine written out flat.
+// --frame-bench is a headless proxy for frameBench.exe: it draws N frames of the sprite into a screen-sized
+// buffer (--screen) allocated for every frame vs. one kept across frames, and reports the time and buffer
+// allocations per frame.
+// --state-machine loads another state machine than stateMachine.json, e.g. one precompiled by smc,
+// and the time loading it took is printed.
+// --no-render only runs the simulation (Update), to time the state machine on its own.
+// --monitors stands in for a multi-monitor desktop (overrides --screen); with --full-screen each
+// monitor gets its own surface and only those the sprite is on are composed.
+// --resampled filters every frame from the source image on each draw instead of using the sub-pixel
+// phase cache; compare its ticks/s with a normal run to see what the cache saves.
+// --rect-blit blends every pixel of the frame rectangle instead of using the frames' alpha spans.
+// --hit-bench runs N IsMouseOver queries around the sprite's final position and reports queries/s.
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include "sprite.h"
+#include "renderer.h"
+#include "monitorLayout.h"
+#include "conditionRegistry.h"
+#include "benchmarks.h"
+
+namespace {
+
+const int OVERLAY_MARGIN = 8; // Same as the sprite-sized overlay in main.cpp
+
+void PrintUsage() {
+    std::cerr << "Usage: headless_sim [--ticks N] [--screen WxH] [--full-screen] "
+                 "[--blit scalar|sse2|avx2] [--dump out.ppm] [--scheduled] [--monitors WxH+X+Y,...] [--resampled] [--rect-blit] [--hit-bench N] [--start-ms T] [--tick-ms N] [--timer-bench N] [--no-render] [--alias-bench N] [--state-machine path] [--expr-bench N] [--tables-bench N] [--plugin path]... [--plugin-bench N] [--blit-bench N] [--check-bench N] [--events-bench N] [--load-bench N] [--hierarchy-bench D] [--frame-bench N]" << std::endl;
+}
+
+}
+
+int main(int argc, char **argv) {
+    long long ticks = 100000;
+    int screenWidth = 1920, screenHeight = 1080;
+    bool fullScreen = false;
+    bool scheduled = false;
+    bool resampled = false;
+    bool rectBlit = false;
+    long long hitQueries = 0;
+    uint32_t startMs = 0;
+    uint32_t tickMs = 16;
+    int timerBenchSprites = 0;
+    int aliasBenchTargets = 0;
+    long long expressionEvaluations = 0;
+    long long tableSteps = 0;
+    long long pluginEvaluations = 0;
+    long long blits = 0;
+    long long transitionChecks = 0;
+    long long eventSteps = 0;
+    int loadBenchStates = 0;
+    int hierarchyDepth = 0;
+    long long benchFrames = 0;
+    bool render = true;
+    std::string dumpPath;
+    std::string monitors;
+    std::string stateMachinePath = "stateMachine.json";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--ticks" && hasValue) {
+            ticks = std::atoll(argv[++i]);
+        } else if (arg == "--screen" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &screenWidth, &screenHeight) != 2) {
+                PrintUsage();
+                return 1;
+            }
+        } else if (arg == "--full-screen") {
+            fullScreen = true;
+        } else if (arg == "--blit" && hasValue) {
+            std::string path = argv[++i];
+            if (path != "scalar" && path != "sse2" && path != "avx2") {
+                std::cerr << "Unknown blitter " << path << std::endl;
+                PrintUsage();
+                return 1;
+            }
+            SetBlitPath(path == "scalar" ? BlitPath::Scalar : path == "sse2" ? BlitPath::SSE2 : BlitPath::AVX2);
+        } else if (arg == "--scheduled") {
+            scheduled = true;
+        } else if (arg == "--no-render") {
+            render = false;
+        } else if (arg == "--timer-bench" && hasValue) {
+            timerBenchSprites = std::atoi(argv[++i]);
+        } else if (arg == "--state-machine" && hasValue) {
+            stateMachinePath = argv[++i];
+        } else if (arg == "--expr-bench" && hasValue) {
+            expressionEvaluations = std::atoll(argv[++i]);
+        } else if (arg == "--plugin" && hasValue) {
+            if (!ConditionRegistry::Global().LoadPlugin(argv[++i])) return 1;
+        } else if (arg == "--plugin-bench" && hasValue) {
+            pluginEvaluations = std::atoll(argv[++i]);
+        } else if (arg == "--check-bench" && hasValue) {
+            transitionChecks = std::atoll(argv[++i]);
+        } else if (arg == "--events-bench" && hasValue) {
+            eventSteps = std::atoll(argv[++i]);
+        } else if (arg == "--load-bench" && hasValue) {
+            loadBenchStates = std::atoi(argv[++i]);
+        } else if (arg == "--hierarchy-bench" && hasValue) {
+            hierarchyDepth = std::min(std::atoi(argv[++i]), 20);
+        } else if (arg == "--frame-bench" && hasValue) {
+            benchFrames = std::atoll(argv[++i]);
+        } else if (arg == "--blit-bench" && hasValue) {
+            blits = std::atoll(argv[++i]);
+        } else if (arg == "--tables-bench" && hasValue) {
+            tableSteps = std::atoll(argv[++i]);
+        } else if (arg == "--alias-bench" && hasValue) {
+            aliasBenchTargets = std::atoi(argv[++i]);
+        } else if (arg == "--tick-ms" && hasValue) {
+            tickMs = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 1));
+        } else if (arg == "--start-ms" && hasValue) {
+            startMs = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--hit-bench" && hasValue) {
+            hitQueries = std::atoll(argv[++i]);
+        } else if (arg == "--rect-blit") {
+            rectBlit = true;
+        } else if (arg == "--resampled") {
+            resampled = true;
+        } else if (arg == "--monitors" && hasValue) {
+            monitors = argv[++i];
+        } else if (arg == "--dump" && hasValue) {
+            dumpPath = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (timerBenchSprites > 0) {
+        RunTimerBenchmark(timerBenchSprites);
+        return 0;
+    }
+    if (expressionEvaluations > 0) {
+        RunExpressionBenchmark(expressionEvaluations);
+        return 0;
+    }
+    if (aliasBenchTargets > 0) {
+        return RunAliasBenchmark(aliasBenchTargets) ? 0 : 1;
+    }
+    if (pluginEvaluations > 0) {
+        RunPluginBenchmark(pluginEvaluations);
+        return 0;
+    }
+    if (tableSteps > 0) {
+        return RunTablesBenchmark(tableSteps) ? 0 : 1;
+    }
+    if (blits > 0) {
+        return RunBlitBenchmark(blits) ? 0 : 1;
+    }
+    if (transitionChecks > 0) {
+        return RunCheckBenchmark(transitionChecks) ? 0 : 1;
+    }
+    if (eventSteps > 0) {
+        return RunEventsBenchmark(eventSteps) ? 0 : 1;
+    }
+    if (loadBenchStates > 0) {
+        return RunLoadBenchmark(loadBenchStates) ? 0 : 1;
+    }
+    if (hierarchyDepth > 0) {
+        return RunHierarchyBenchmark(hierarchyDepth) ? 0 : 1;
+    }
+    if (benchFrames > 0) {
+        RunFrameBenchmark(benchFrames, screenWidth, screenHeight);
+        return 0;
+    }
+
+    MonitorLayout monitorLayout;
+    if (monitors.empty()) {
+        monitorLayout.AddMonitor({ 0, 0, screenWidth, screenHeight });
+    } else if (!monitorLayout.Parse(monitors)) {
+        std::cerr << "Invalid monitor layout: " << monitors << std::endl;
+        return 1;
+    }
+    ScreenRect world = monitorLayout.GetVirtualBounds();
+    const ScreenRect &primary = monitorLayout.GetBounds(monitorLayout.GetPrimary());
+
+    // Real time, or a simulated clock that only moves from deadline to deadline
+    ManualClock simulatedClock(static_cast<uint64_t>(startMs) * 1000000);
+    Sprite sprite(world.Width(), world.Height(), scheduled ? static_cast<const Clock &>(simulatedClock) : SystemClock());
+    sprite.SetWorldBounds(world.left, world.top, world.Width(), world.Height());
+    sprite.LoadAnimations("animations");
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!sprite.LoadStateMachine(stateMachinePath)) return 1;
+    std::cout << "State machine " << stateMachinePath << " loaded in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count() << " ms" << std::endl;
+    sprite.SetHeight(150);
+    sprite.SetPosition(primary.right - 3*sprite.GetWidth(), primary.bottom - sprite.GetHeight() - 50);
+
+    // One surface following the sprite, or one per monitor in full-screen mode
+    std::vector<HeadlessRenderer> renderers;
+    std::vector<bool> hasSprite;
+    int surfaceCount = fullScreen ? monitorLayout.GetCount() : 1;
+    for (int i = 0; i < surfaceCount; i++) {
+        const ScreenRect &bounds = monitorLayout.GetBounds(i);
+        renderers.emplace_back(bounds.Width(), bounds.Height());
+        renderers.back().SetOrigin(bounds.left, bounds.top);
+        renderers.back().SetUseAlphaSpans(!rectBlit);
+        hasSprite.push_back(true); // Everything gets composed once
+    }
+    long long pixelsRendered = 0;
+    PresentStats presentStats;
+    TickScheduler scheduler(tickMs);
+    uint64_t simulatedStart = simulatedClock.NowNs();
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long tick = 0; tick < ticks; tick++) {
+        bool changed = sprite.Update();
+        if (scheduled) {
+            uint32_t delay = scheduler.GetDelay(sprite.GetNextDeadline(), simulatedClock.NowMs());
+            if (delay == TickScheduler::NO_WAKEUP) {
+                std::cout << "Idle with nothing scheduled after " << tick + 1 << " ticks" << std::endl;
+                ticks = tick + 1;
+                break;
+            }
+            simulatedClock.AdvanceMs(std::max<uint32_t>(delay, 1));
+        }
+
+        // Nothing visible changed, nothing to compose
+        if (!changed || !render) {
+            presentStats.skipped++;
+            continue;
+        }
+
+        // Same surface layout as the Windows overlays
+        ScreenRect spriteRect = { sprite.GetX(), sprite.GetY(), sprite.GetX() + sprite.GetWidth(), sprite.GetY() + sprite.GetHeight() };
+        uint64_t spriteMonitors = monitorLayout.GetIntersecting(spriteRect);
+        if (!fullScreen) {
+            HeadlessRenderer &renderer = renderers[0];
+            renderer.Resize(sprite.GetWidth() + 2 * OVERLAY_MARGIN, sprite.GetHeight() + 2 * OVERLAY_MARGIN);
+            renderer.SetOrigin(sprite.GetX() - OVERLAY_MARGIN, sprite.GetY() - OVERLAY_MARGIN);
+            renderer.Clear();
+            if (resampled) sprite.DrawResampled(renderer);
+            else sprite.Draw(renderer);
+            pixelsRendered += static_cast<long long>(renderer.GetSurface().width) * renderer.GetSurface().height;
+            for (int i = 0; i < monitorLayout.GetCount(); i++) {
+                if (spriteMonitors & (uint64_t(1) << i)) monitorLayout.CountPresent(i);
+            }
+        } else {
+            // Only the monitors the sprite is on, plus one last clear for any it just left
+            for (int i = 0; i < surfaceCount; i++) {
+                bool onMonitor = (spriteMonitors & (uint64_t(1) << i)) != 0;
+                if (!onMonitor && !hasSprite[i]) continue;
+
+                renderers[i].Clear();
+                if (resampled) sprite.DrawResampled(renderers[i]);
+                else sprite.Draw(renderers[i]);
+                pixelsRendered += static_cast<long long>(renderers[i].GetSurface().width) * renderers[i].GetSurface().height;
+                hasSprite[i] = onMonitor;
+                monitorLayout.CountPresent(i);
+            }
+        }
+        presentStats.presented++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Ticks: " << ticks << " in " << seconds << " s"
+              << " (" << (seconds > 0 ? ticks / seconds : 0) << " ticks/s)" << std::endl;
+    std::cout << "Blitter: " << GetBlitPathName(GetBlitPath())
+              << ", pixels per presented frame: "
+              << (presentStats.presented ? pixelsRendered / presentStats.presented : 0) << std::endl;
+    std::cout << "Frames presented: " << presentStats.presented << ", skipped: " << presentStats.skipped << std::endl;
+    if (scheduled) {
+        double simulatedSeconds = (simulatedClock.NowNs() - simulatedStart) / 1e9;
+        std::cout << "Simulated " << simulatedSeconds << " s, "
+                  << (simulatedSeconds > 0 ? ticks / simulatedSeconds : 0) << " wakeups per simulated second" << std::endl;
+    }
+
+    const Atlas *atlases[] = { &sprite.GetSourceAtlas(), &sprite.GetFrameAtlas() };
+    const char *atlasNames[] = { "Source atlas", "Frame atlas" };
+    for (int i = 0; i < 2; i++) {
+        const Atlas &atlas = *atlases[i];
+        std::cout << atlasNames[i] << ": " << atlas.GetPageCount() << " page(s), " << atlas.GetBytes() / 1024 << " KB, "
+                  << static_cast<int>(atlas.GetOccupancy() * 100) << "% occupied, "
+                  << (atlas.GetBytes() - atlas.GetUsedBytes()) / 1024 << " KB wasted" << std::endl;
+    }
+    for (int i = 0; i < monitorLayout.GetCount(); i++) {
+        const ScreenRect &bounds = monitorLayout.GetBounds(i);
+        std::cout << "Monitor " << i << " (" << bounds.Width() << "x" << bounds.Height() << std::showpos << bounds.left << bounds.top
+                  << std::noshowpos << "): " << monitorLayout.GetPresentCount(i) << " presents" << std::endl;
+    }
+    size_t spanBytes = 0, copiedPixels = 0, blendedPixels = 0, framePixels = 0;
+    for (const AlphaSpans &spans : sprite.GetFrameSpans()) {
+        spanBytes += spans.Bytes();
+        copiedPixels += spans.copiedPixels;
+        blendedPixels += spans.blendedPixels;
+        framePixels += static_cast<size_t>(spans.width) * spans.height;
+    }
+    if (framePixels > 0) {
+        std::cout << "Alpha spans: " << spanBytes / 1024 << " KB, " << copiedPixels * 100 / framePixels << "% copied, "
+                  << blendedPixels * 100 / framePixels << "% blended, "
+                  << (framePixels - copiedPixels - blendedPixels) * 100 / framePixels << "% skipped" << std::endl;
+    }
+    std::cout << "Hit masks: " << sprite.GetHitMaskBytes() / 1024 << " KB" << std::endl;
+    if (hitQueries > 0) {
+        // Points spread over twice the sprite's bounding box, so about three quarters are rejected by the box
+        uint32_t seed = 12345;
+        int areaWidth = 2 * sprite.GetWidth(), areaHeight = 2 * sprite.GetHeight();
+        int areaX = sprite.GetX() - sprite.GetWidth() / 2, areaY = sprite.GetY() - sprite.GetHeight() / 2;
+        long long hits = 0;
+        auto hitStart = std::chrono::steady_clock::now();
+        for (long long q = 0; q < hitQueries; q++) {
+            seed = seed * 1664525u + 1013904223u;
+            int px = areaX + static_cast<int>((seed >> 8) % areaWidth);
+            int py = areaY + static_cast<int>((seed >> 20) % areaHeight);
+            hits += sprite.IsMouseOver(px, py);
+        }
+        double hitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hitStart).count();
+        std::cout << "Hit test: " << hitQueries << " queries, " << hits * 100 / hitQueries << "% hits, "
+                  << (hitSeconds > 0 ? hitQueries / hitSeconds / 1e6 : 0) << " M queries/s" << std::endl;
+    }
+    std::cout << "Saved by mirrored animations: " << sprite.GetMirrorSavedBytes() / 1024 << " KB" << std::endl;
+
+    // Full-screen dumps show the primary monitor
+    const HeadlessRenderer &dumped = renderers[fullScreen ? monitorLayout.GetPrimary() : 0];
+    if (!dumpPath.empty() && !dumped.WritePpm(dumpPath)) {
+        std::cerr << "Failed to write " << dumpPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "image.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <gdiplus.h>
+#else
+#include "png.h"
+#endif
+
+#ifdef _WIN32
+
+bool LoadImageFile(const std::string& path, Image& out) {
+    std::wstring widePath(path.begin(), path.end());
+    Gdiplus::Bitmap bitmap(widePath.c_str());
+    if (bitmap.GetLastStatus() != Gdiplus::Ok) return false;
+
+    out.width = static_cast<int>(bitmap.GetWidth());
+    out.height = static_cast<int>(bitmap.GetHeight());
+    out.pixels.assign(static_cast<size_t>(out.width) * out.height, 0);
+
+    // Let GDI+ convert straight into our buffer as premultiplied BGRA
+    Gdiplus::BitmapData data = {};
+    data.Width = out.width;
+    data.Height = out.height;
+    data.Stride = out.width * 4;
+    data.PixelFormat = PixelFormat32bppPARGB;
+    data.Scan0 = out.pixels.data();
+    Gdiplus::Rect rect(0, 0, out.width, out.height);
+    if (bitmap.LockBits(&rect, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+                        PixelFormat32bppPARGB, &data) != Gdiplus::Ok) {
+        out = Image();
+        return false;
+    }
+    bitmap.UnlockBits(&data);
+    return true;
+}
+
+#else
+
+bool LoadImageFile(const std::string& path, Image& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return DecodePng(data, out);
+}
+
+#endif
+
+void ScaleImage(const ImageView& src, uint32_t* dst, int dstStride, int w, int h) {
+    if (src.Empty() || w <= 0 || h <= 0) return;
+
+    // Sample positions in 16.16 fixed point, pixel centres aligned
+    auto sourcePos = [](int i, int srcSize, int dstSize) {
+        long long pos = ((2LL * i + 1) * srcSize * 65536) / (2LL * dstSize) - 32768;
+        return std::clamp(pos, 0LL, static_cast<long long>(srcSize - 1) * 65536);
+    };
+
+    for (int row = 0; row < h; row++) {
+        long long sy = sourcePos(row, src.height, h);
+        int y0 = static_cast<int>(sy >> 16);
+        int y1 = std::min(y0 + 1, src.height - 1);
+        uint32_t fy = static_cast<uint32_t>(sy & 0xFFFF) >> 8;
+        const uint32_t* row0 = src.pixels + static_cast<size_t>(y0) * src.stride;
+        const uint32_t* row1 = src.pixels + static_cast<size_t>(y1) * src.stride;
+        uint32_t* out = dst + static_cast<size_t>(row) * dstStride;
+
+        for (int col = 0; col < w; col++) {
+            long long sx = sourcePos(col, src.width, w);
+            int x0 = static_cast<int>(sx >> 16);
+            int x1 = std::min(x0 + 1, src.width - 1);
+            uint32_t fx = static_cast<uint32_t>(sx & 0xFFFF) >> 8;
+
+            uint32_t p00 = row0[x0], p01 = row0[x1], p10 = row1[x0], p11 = row1[x1];
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t top = ((p00 >> shift) & 0xFF) * (256 - fx) + ((p01 >> shift) & 0xFF) * fx;
+                uint32_t bottom = ((p10 >> shift) & 0xFF) * (256 - fx) + ((p11 >> shift) & 0xFF) * fx;
+                uint32_t value = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+                result |= std::min(value, 255u) << shift;
+            }
+            out[col] = result;
+        }
+    }
+}
+
+void ShiftImage(const ImageView& src, uint32_t* dst, int dstStride, int shift) {
+    if (src.Empty()) return;
+    uint32_t keep = static_cast<uint32_t>(256 - std::clamp(shift, 0, 256));
+    uint32_t spill = 256 - keep;
+
+    for (int row = 0; row < src.height; row++) {
+        const uint32_t* in = src.pixels + static_cast<size_t>(row) * src.stride;
+        uint32_t* out = dst + static_cast<size_t>(row) * dstStride;
+
+        // Output column c gets `keep` of input c and `spill` of input c - 1 (premultiplied, so a plain lerp)
+        for (int col = 0; col <= src.width; col++) {
+            uint32_t current = col < src.width ? in[col] : 0;
+            uint32_t previous = col > 0 ? in[col - 1] : 0;
+            uint32_t result = 0;
+            for (int bits = 0; bits < 32; bits += 8) {
+                uint32_t value = (((current >> bits) & 0xFF) * keep + ((previous >> bits) & 0xFF) * spill + 128) >> 8;
+                result |= value << bits;
+            }
+            out[col] = result;
+        }
+    }
+}
+
+void BuildHitMask(const ImageView& src, HitMask& out, int minAlpha) {
+    out.width = src.width;
+    out.height = src.height;
+    out.wordsPerRow = (src.width + 63) / 64;
+    out.bits.assign(static_cast<size_t>(out.wordsPerRow) * src.height, 0);
+    if (src.Empty()) return;
+
+    uint32_t threshold = static_cast<uint32_t>(std::clamp(minAlpha, 1, 255));
+    for (int row = 0; row < src.height; row++) {
+        const uint32_t* in = src.pixels + static_cast<size_t>(row) * src.stride;
+        uint64_t* words = out.bits.data() + static_cast<size_t>(row) * out.wordsPerRow;
+        for (int col = 0; col < src.width; col++) {
+            if ((in[col] >> 24) >= threshold) words[col >> 6] |= uint64_t(1) << (col & 63);
+        }
+    }
+}
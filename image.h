@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Non-owning view of premultiplied BGRA pixels, e.g. a sub-rectangle of an atlas page
+struct ImageView
+{
+    const uint32_t *pixels = nullptr;
+    int width = 0, height = 0;
+    int stride = 0; // In pixels
+
+    bool Empty() const { return pixels == nullptr || width <= 0 || height <= 0; }
+};
+
+// Decoded image as premultiplied BGRA (the layout the blitter and layered windows want)
+struct Image
+{
+    int width = 0, height = 0;
+    std::vector<uint32_t> pixels; // width * height, tightly packed
+
+    bool Empty() const { return pixels.empty(); }
+    size_t Bytes() const { return pixels.size() * sizeof(uint32_t); }
+    ImageView View() const { return { pixels.data(), width, height, width }; }
+};
+
+// One bit per pixel: set where the image is visible, for hit testing
+struct HitMask
+{
+    int width = 0, height = 0;
+    int wordsPerRow = 0;
+    std::vector<uint64_t> bits;
+
+    bool Empty() const { return bits.empty(); }
+    size_t Bytes() const { return bits.size() * sizeof(uint64_t); }
+    // (x, y) must be inside the mask
+    bool Test(int x, int y) const {
+        return (bits[static_cast<size_t>(y) * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+    }
+};
+
+// Loads an image file. On Windows this goes through GDI+ (GdiplusStartup must have been called),
+// elsewhere through our own PNG decoder.
+bool LoadImageFile(const std::string& path, Image& out);
+
+// Bilinear resample of src into a w x h block at dst (done once when frames are baked, never per draw)
+void ScaleImage(const ImageView& src, uint32_t* dst, int dstStride, int w, int h);
+
+// Copies src shifted right by shift/256 of a pixel into a (src.width + 1) x src.height block at dst,
+// blending neighbouring columns. Used to pre-bake sub-pixel positions of a frame.
+void ShiftImage(const ImageView& src, uint32_t* dst, int dstStride, int shift);
+
+// Sets a mask bit for every pixel with alpha >= minAlpha
+void BuildHitMask(const ImageView& src, HitMask& out, int minAlpha = 1);
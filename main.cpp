@@ -3,7 +3,16 @@
 #include <vector>
 #include <string>
 #include "sprite.h"
+#include "renderTarget.h"
+#include "monitorLayout.h"
+#ifdef KIOSK_BUILD
+#include "stateTables.h"
+#endif
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
@@ -19,87 +28,248 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 const int ANIMATION_TIMER_ID = 0;
 
-const int screenHeight = GetSystemMetrics(SM_CYSCREEN);
-const int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-Sprite sprite(screenWidth, screenHeight);
-
-void RedrawSprite(HWND hwnd) {
-    HDC hdcScreen = GetDC(nullptr);
-    HDC hdcMem = CreateCompatibleDC(hdcScreen);
-
-    BITMAPINFO bmi = {};
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = sprite.GetScreenWidth();
-    bmi.bmiHeader.biHeight = -sprite.GetScreenHeight();
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    void* pvBits = nullptr;
-    HBITMAP hBitmap = CreateDIBSection(hdcMem, &bmi, DIB_RGB_COLORS, &pvBits, nullptr, 0);
-    SelectObject(hdcMem, hBitmap);
-
-    Graphics graphics(hdcMem);
-    graphics.Clear(Color(0, 0, 0, 0)); // Transparent background
-
-    try {
-        sprite.Draw(graphics);
-    } catch (...) {
-        MessageBox(nullptr, L"Crash during Draw()!", L"Error", MB_OK);
-    }
-    
-    // Apply to layered window
-    SIZE wndSize = { screenWidth, screenHeight };
-    POINT srcPt = { 0, 0 };
-    POINT ptDst = { 0, 0 };
-    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
-    UpdateLayeredWindow(hwnd, hdcScreen, &ptDst, &wndSize, hdcMem, &srcPt, 0, &blend, ULW_ALPHA);
+// Monitors of the virtual desktop, the sprite walks across all of them
+MonitorLayout monitorLayout;
+Sprite sprite(GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN));
 
-    // Cleanup
-    DeleteObject(hBitmap);
-    DeleteDC(hdcMem);
-    ReleaseDC(nullptr, hdcScreen);
+// When true the layered window only covers the sprite (plus a margin) and follows it around,
+// so each frame pushes sprite-sized pixels instead of the whole screen.
+// When false there's one full-size overlay per monitor, and only those the sprite is on get redrawn.
+const bool spriteSizedOverlay = true;
+const int OVERLAY_MARGIN = 8;
+
+// When true frames are blended into the back buffer by our own SIMD blitter instead of GDI+ DrawImage
+const bool softwareBlit = true;
+
+// A layered window together with its back buffer
+struct Overlay
+{
+    HWND hwnd = nullptr;
+    RenderTarget renderTarget;   // Back buffer reused across frames
+    POINT origin = { 0, 0 };     // Screen position of the overlay's top-left corner
+    bool hasSprite = false;      // Sprite was on it at the last present, so it needs clearing once it leaves
+};
+std::vector<std::unique_ptr<Overlay>> overlays; // overlays[0] owns the timer and ends the app when closed
+HINSTANCE appInstance = nullptr;
+PresentStats presentStats;
+
+TickScheduler scheduler; // Fixed 16ms (~60 FPS) only while the sprite is moving
+int wakeups = 0;
+
+ScreenRect GetSpriteRect() {
+    return { sprite.GetX(), sprite.GetY(), sprite.GetX() + sprite.GetWidth(), sprite.GetY() + sprite.GetHeight() };
+}
+
+// Screen rectangle overlay i should cover this frame
+RECT GetOverlayRect(size_t i) {
+    if (!spriteSizedOverlay) {
+        const ScreenRect& bounds = monitorLayout.GetBounds(static_cast<int>(i));
+        return { bounds.left, bounds.top, bounds.right, bounds.bottom };
+    }
+    return { sprite.GetX() - OVERLAY_MARGIN, sprite.GetY() - OVERLAY_MARGIN,
+             sprite.GetX() + sprite.GetWidth() + OVERLAY_MARGIN, sprite.GetY() + sprite.GetHeight() + OVERLAY_MARGIN };
+}
+
+void PresentOverlay(Overlay& overlayWindow, const RECT& overlay) {
+    RenderTarget& renderTarget = overlayWindow.renderTarget;
+
+    // Only reallocates if the overlay size changed since the last frame
+    if (!renderTarget.Resize(overlay.right - overlay.left, overlay.bottom - overlay.top)) return;
+
+    POINT origin = { overlay.left, overlay.top };
+    if (softwareBlit) {
+        Surface surface;
+        surface.pixels = static_cast<uint32_t*>(renderTarget.GetBits());
+        surface.width = surface.stride = renderTarget.GetWidth();
+        surface.height = renderTarget.GetHeight();
+        surface.originX = origin.x;
+        surface.originY = origin.y;
+
+        GdiFlush(); // Make sure GDI is done with the DIB before touching its bits
+        SurfaceRenderer renderer(surface);
+        renderer.Clear();
+        sprite.Draw(renderer);
+    } else {
+        GdiplusRenderer renderer(renderTarget, origin);
+        renderer.Clear();
+        try {
+            sprite.Draw(renderer);
+        } catch (...) {
+            MessageBox(nullptr, L"Crash during Draw()!", L"Error", MB_OK);
+        }
+    }
+
+    // Apply to layered window, moving it to the sprite if needed
+    overlayWindow.origin = origin;
+    renderTarget.Present(overlayWindow.hwnd, origin);
+    presentStats.presented++;
+}
+
+void RedrawSprite() {
+    uint64_t spriteMonitors = monitorLayout.GetIntersecting(GetSpriteRect());
+
+    if (spriteSizedOverlay) {
+        PresentOverlay(*overlays[0], GetOverlayRect(0));
+        for (int i = 0; i < monitorLayout.GetCount(); i++) {
+            if (spriteMonitors & (uint64_t(1) << i)) monitorLayout.CountPresent(i);
+        }
+        return;
+    }
+
+    // Compose only the monitors the sprite is on, plus one last (empty) present for any it just left
+    for (size_t i = 0; i < overlays.size(); i++) {
+        bool onMonitor = (spriteMonitors & (uint64_t(1) << i)) != 0;
+        if (!onMonitor && !overlays[i]->hasSprite) continue;
+
+        PresentOverlay(*overlays[i], GetOverlayRect(i));
+        overlays[i]->hasSprite = onMonitor;
+        monitorLayout.CountPresent(static_cast<int>(i));
+    }
+}
+
+BOOL CALLBACK AddMonitor(HMONITOR, HDC, LPRECT rect, LPARAM) {
+    monitorLayout.AddMonitor({ static_cast<int>(rect->left), static_cast<int>(rect->top),
+                               static_cast<int>(rect->right), static_cast<int>(rect->bottom) });
+    return TRUE;
+}
+
+// Reads the monitor setup and lets the sprite roam the whole virtual desktop
+void LoadMonitorLayout() {
+    monitorLayout.Clear();
+    EnumDisplayMonitors(nullptr, nullptr, AddMonitor, 0);
+    if (monitorLayout.GetCount() == 0) {
+        monitorLayout.AddMonitor({ 0, 0, GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN) });
+    }
+
+    ScreenRect world = monitorLayout.GetVirtualBounds();
+    sprite.SetWorldBounds(world.left, world.top, world.Width(), world.Height());
+
+    // A monitor the sprite was on may have gone or moved; the union of the rest can still hold its old
+    // position in a gap between monitors, so put it back on one of them
+    ScreenRect spriteRect = GetSpriteRect(), moved = monitorLayout.MoveOntoMonitor(spriteRect);
+    if (moved.left != spriteRect.left || moved.top != spriteRect.top) {
+        sprite.SetPosition(static_cast<float>(moved.left), static_cast<float>(moved.top));
+    }
 }
 
+// Creates or destroys overlay windows until there's one per surface, and moves them into place
+void SyncOverlayWindows() {
+    size_t needed = spriteSizedOverlay ? 1 : static_cast<size_t>(monitorLayout.GetCount());
+
+    while (overlays.size() > needed) {
+        HWND hwnd = overlays.back()->hwnd;
+        overlays.pop_back();
+        DestroyWindow(hwnd);
+    }
+    while (overlays.size() < needed) {
+        RECT overlay = GetOverlayRect(overlays.size());
+
+        // Create layered, transparent, topmost window
+        auto overlayWindow = std::make_unique<Overlay>();
+        overlayWindow->hwnd = CreateWindowExW(
+            WS_EX_LAYERED |  WS_EX_TOPMOST,
+            L"OverlayWindowClass",
+            L"MyDesktopGame",
+            WS_POPUP, // No border, no title bar
+            overlay.left, overlay.top, overlay.right - overlay.left, overlay.bottom - overlay.top,
+            nullptr, nullptr, appInstance, nullptr
+        );
+        overlayWindow->origin = { overlay.left, overlay.top };
+        overlays.push_back(std::move(overlayWindow));
+        ShowWindow(overlays.back()->hwnd, SW_SHOW);
+    }
+
+    // Force one present everywhere so resized monitors get redrawn (or cleared)
+    for (auto& overlay : overlays) {
+        overlay->hasSprite = true;
+    }
+}
+
+// Re-arms the one-shot animation timer for the sprite's next deadline
+// (next frame, next timed transition, or the fixed rate while moving)
+void ScheduleNextTick() {
+    HWND hwnd = overlays[0]->hwnd;
+    uint32_t delay = scheduler.GetDelay(sprite.GetNextDeadline(), SystemClock().NowMs());
+    if (delay == TickScheduler::NO_WAKEUP) {
+        KillTimer(hwnd, ANIMATION_TIMER_ID); // Nothing to do until input arrives
+        return;
+    }
+    // Replaces the pending timer with the same ID
+    SetTimer(hwnd, ANIMATION_TIMER_ID, std::max<UINT>(delay, USER_TIMER_MINIMUM), nullptr);
+}
+
+#ifndef KIOSK_BUILD
+// stateMachine.bin is only what smc made of stateMachine.json when it last ran (see Makefile), so it's used
+// only if it isn't older than the JSON; an edited JSON wins until the blob is rebuilt
+const char *PickStateMachine() {
+    WIN32_FILE_ATTRIBUTE_DATA json, binary;
+    if (!GetFileAttributesExA("stateMachine.bin", GetFileExInfoStandard, &binary)) return "stateMachine.json";
+    if (!GetFileAttributesExA("stateMachine.json", GetFileExInfoStandard, &json)) return "stateMachine.bin";
+    if (CompareFileTime(&binary.ftLastWriteTime, &json.ftLastWriteTime) < 0) {
+        std::cerr << "stateMachine.bin is older than stateMachine.json, loading the JSON (run nmake to rebuild it)" << std::endl;
+        return "stateMachine.json";
+    }
+    return "stateMachine.bin";
+}
+#endif
+
 // Entry point
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR commandLine, int) {
+    // A GUI program has no console for std::cerr; --stats borrows the terminal it was started from, or opens one
+    if (std::string(commandLine).find("--stats") != std::string::npos) {
+        if (!AttachConsole(ATTACH_PARENT_PROCESS)) AllocConsole();
+        FILE* console = nullptr;
+        freopen_s(&console, "CONOUT$", "w", stderr);
+        std::cerr.clear();
+    }
+
     // Init GDI+
     GdiplusStartupInput gdiPlusStartupInput;
     GdiplusStartup(&gdiplusToken, &gdiPlusStartupInput, nullptr);
 
+    // Custom transition conditions, before the state machine that names them
+    ConditionRegistry::Global().LoadPlugins("plugins");
+
+#ifdef KIOSK_BUILD
+    // Behaviour and animations compiled in by smc --header (nmake kiosk.exe)
+    sprite.LoadStateTables<StateTables>();
+#else
     // Load animation frames
     sprite.LoadAnimations("animations");
-    sprite.LoadStateMachine(L"stateMachine.json");
+    // Precompiled by smc when it's up to date, so startup skips parsing the JSON
+    std::string stateMachinePath = PickStateMachine();
+    if (!sprite.LoadStateMachine(stateMachinePath) && stateMachinePath != "stateMachine.json") {
+        std::cerr << "Couldn't load " << stateMachinePath << ", loading stateMachine.json" << std::endl;
+        sprite.LoadStateMachine("stateMachine.json");
+    }
+#endif
 
-    // Set size
+    // Set size, this also bakes every frame at display size
     sprite.SetHeight(150);
+    const Atlas& atlas = sprite.GetFrameAtlas();
+    std::cerr << "Frame cache: " << sprite.GetFrameCacheBytes() / 1024 << " KB in " << atlas.GetPageCount()
+              << " atlas page(s), " << static_cast<int>(atlas.GetOccupancy() * 100) << "% occupied, "
+              << sprite.GetMirrorSavedBytes() / 1024 << " KB saved by mirrored animations" << std::endl;
+    if (softwareBlit) std::cerr << "Blitter: " << GetBlitPathName(GetBlitPath()) << std::endl;
 
-    // Starting position
-    sprite.SetPosition(sprite.GetScreenWidth() - 3*sprite.GetWidth(), sprite.GetScreenHeight() - sprite.GetHeight() - 50);
+    // Starting position, bottom right of the primary monitor
+    LoadMonitorLayout();
+    const ScreenRect& primary = monitorLayout.GetBounds(monitorLayout.GetPrimary());
+    sprite.SetPosition(primary.right - 3*sprite.GetWidth(), primary.bottom - sprite.GetHeight() - 50);
 
     // THE WINDOW
     // Register window class
+    appInstance = hInstance;
     WNDCLASSW wc = { };
     wc.lpfnWndProc = WindowProc;
     wc.hInstance = hInstance;
     wc.lpszClassName = L"OverlayWindowClass";
     RegisterClassW(&wc);
 
-    // Create layered, transparent, topmost window
-    HWND hwnd = CreateWindowExW(
-        WS_EX_LAYERED |  WS_EX_TOPMOST,
-        wc.lpszClassName,
-        L"MyDesktopGame",
-        WS_POPUP, // No border, no title bar
-        0, 0, screenWidth, screenHeight,
-        nullptr, nullptr, hInstance, nullptr
-    );
-    
+    SyncOverlayWindows();
 
     // Set timer
-    SetTimer(hwnd, ANIMATION_TIMER_ID, 16, nullptr);  // ~60 FPS
-
-    ShowWindow(hwnd, SW_SHOW);
+    ScheduleNextTick();
 
     // Message loop
     // Keeps the window alive until closed. Even if you're not interacting with it, Windows needs this loop to process system events.
@@ -109,7 +279,27 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
         DispatchMessage(&msg);
     }
 
+    int frames = 0, allocations = 0;
+    long long pixelsPushed = 0;
+    for (const auto& overlay : overlays) {
+        frames += overlay->renderTarget.GetFrameCount();
+        allocations += overlay->renderTarget.GetAllocationCount();
+        pixelsPushed += overlay->renderTarget.GetPixelsPushed();
+    }
+    // Also to the debugger (or DebugView), which sees them without --stats
+    std::ostringstream stats;
+    stats << "Frames: " << frames << " presented, " << presentStats.skipped << " skipped"
+          << ", back buffer allocations: " << allocations
+          << ", pixels pushed per frame: " << (frames ? pixelsPushed / frames : 0)
+          << ", timer wakeups: " << wakeups << "\n";
+    for (int i = 0; i < monitorLayout.GetCount(); i++) {
+        stats << "Monitor " << i << ": " << monitorLayout.GetPresentCount(i) << " presents\n";
+    }
+    std::cerr << stats.str() << std::flush;
+    OutputDebugStringA(stats.str().c_str());
+
     // Cleanup
+    overlays.clear(); // Graphics must go before GDI+ shuts down
     GdiplusShutdown(gdiplusToken);
 
     return 0;
@@ -117,12 +307,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
 
 // Handles the WM_DESTROY message (sent when window closes), so app quits cleanly.
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    int mouseX = LOWORD(lParam);
-    int mouseY = HIWORD(lParam);
+    // Mouse positions are relative to the overlay, the sprite works in screen coordinates
+    POINT overlayOrigin = { 0, 0 };
+    for (const auto& overlay : overlays) {
+        if (overlay->hwnd == hwnd) overlayOrigin = overlay->origin;
+    }
+    int mouseX = static_cast<short>(LOWORD(lParam)) + overlayOrigin.x;
+    int mouseY = static_cast<short>(HIWORD(lParam)) + overlayOrigin.y;
 
     switch (uMsg) {
         case WM_LBUTTONDOWN: {  // Left mouse button click
             sprite.OnMouseClick(mouseX, mouseY); // Call sprite's click handler
+            ScheduleNextTick(); // A click may need handling sooner than the pending deadline
             return 0;
         }
 
@@ -138,8 +334,14 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
         case WM_TIMER: {
             if (wParam == ANIMATION_TIMER_ID) {
-                sprite.Update(); // Handles animation + movement
-                InvalidateRect(hwnd, nullptr, FALSE); // Redraw
+                // Handles animation + movement, only redraw if something visible changed
+                if (sprite.Update()) {
+                    InvalidateRect(hwnd, nullptr, FALSE);
+                } else {
+                    presentStats.skipped++;
+                }
+                wakeups++;
+                ScheduleNextTick();
             }
             return 0;
         }
@@ -147,15 +349,26 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             PAINTSTRUCT ps;
             BeginPaint(hwnd, &ps);
 
-            // Redraw overlay with new position + frame
-            RedrawSprite(hwnd);
+            // Redraw overlays with new position + frame
+            RedrawSprite();
 
             EndPaint(hwnd, &ps);
             return 0;
         }
+        case WM_DISPLAYCHANGE: {
+            // Monitors changed: re-read the layout and match the overlays to it,
+            // back buffers follow on the next redraw
+            LoadMonitorLayout();
+            SyncOverlayWindows();
+            InvalidateRect(overlays[0]->hwnd, nullptr, FALSE);
+            return 0;
+        }
         case WM_DESTROY: {
-            KillTimer(hwnd, ANIMATION_TIMER_ID);
-            PostQuitMessage(0);
+            // Overlays for monitors that went away are destroyed too, only the first one ends the app
+            if (!overlays.empty() && hwnd == overlays[0]->hwnd) {
+                KillTimer(hwnd, ANIMATION_TIMER_ID);
+                PostQuitMessage(0);
+            }
             return 0;
         }
     }
@@ -0,0 +1,90 @@
+#include "monitorLayout.h"
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+
+void MonitorLayout::Clear() {
+    monitors.clear();
+}
+
+bool MonitorLayout::AddMonitor(const ScreenRect &bounds) {
+    if (GetCount() >= MAX_MONITORS || bounds.Width() <= 0 || bounds.Height() <= 0) return false;
+    Monitor monitor;
+    monitor.bounds = bounds;
+    monitors.push_back(monitor);
+    return true;
+}
+
+bool MonitorLayout::Parse(const std::string &description) {
+    Clear();
+    std::stringstream stream(description);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        // WxH, optionally followed by a signed +X+Y offset
+        int w = 0, h = 0, x = 0, y = 0;
+        int fields = std::sscanf(item.c_str(), "%dx%d%d%d", &w, &h, &x, &y);
+        if (fields != 2 && fields != 4) return false;
+        if (!AddMonitor({ x, y, x + w, y + h })) return false;
+    }
+    return GetCount() > 0;
+}
+
+ScreenRect MonitorLayout::GetVirtualBounds() const {
+    if (monitors.empty()) return {};
+    ScreenRect bounds = monitors[0].bounds;
+    for (const auto &monitor : monitors) {
+        bounds.left = std::min(bounds.left, monitor.bounds.left);
+        bounds.top = std::min(bounds.top, monitor.bounds.top);
+        bounds.right = std::max(bounds.right, monitor.bounds.right);
+        bounds.bottom = std::max(bounds.bottom, monitor.bounds.bottom);
+    }
+    return bounds;
+}
+
+int MonitorLayout::GetPrimary() const {
+    for (int i = 0; i < GetCount(); i++) {
+        if (monitors[i].bounds.Intersects({ 0, 0, 1, 1 })) return i;
+    }
+    return 0;
+}
+
+uint64_t MonitorLayout::GetIntersecting(const ScreenRect &rect) const {
+    uint64_t mask = 0;
+    for (int i = 0; i < GetCount(); i++) {
+        if (monitors[i].bounds.Intersects(rect)) mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+
+ScreenRect MonitorLayout::MoveOntoMonitor(const ScreenRect &rect) const {
+    if (monitors.empty()) return rect;
+    int best = 0;
+    long long bestOverlap = -1, bestDistance = 0;
+    for (int i = 0; i < GetCount(); i++) {
+        const ScreenRect &bounds = monitors[i].bounds;
+        long long overlapW = std::min(rect.right, bounds.right) - std::max(rect.left, bounds.left);
+        long long overlapH = std::min(rect.bottom, bounds.bottom) - std::max(rect.top, bounds.top);
+        long long overlap = overlapW > 0 && overlapH > 0 ? overlapW * overlapH : 0;
+        // Gap between the two along each axis, zero where they line up
+        long long gapX = std::max({ 0, bounds.left - rect.right, rect.left - bounds.right });
+        long long gapY = std::max({ 0, bounds.top - rect.bottom, rect.top - bounds.bottom });
+        long long distance = gapX * gapX + gapY * gapY;
+        if (overlap > bestOverlap || (overlap == bestOverlap && distance < bestDistance)) {
+            best = i;
+            bestOverlap = overlap;
+            bestDistance = distance;
+        }
+    }
+
+    // Right/bottom first so a rect bigger than the monitor ends up at its top-left corner
+    const ScreenRect &bounds = monitors[best].bounds;
+    ScreenRect moved = rect;
+    int dx = std::min(0, bounds.right - rect.right), dy = std::min(0, bounds.bottom - rect.bottom);
+    dx = std::max(dx, bounds.left - rect.left);
+    dy = std::max(dy, bounds.top - rect.top);
+    moved.left += dx;
+    moved.right += dx;
+    moved.top += dy;
+    moved.bottom += dy;
+    return moved;
+}
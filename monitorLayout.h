@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Rectangle in virtual-desktop coordinates, right/bottom exclusive
+struct ScreenRect
+{
+    int left = 0, top = 0, right = 0, bottom = 0;
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+    bool Intersects(const ScreenRect &other) const {
+        return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+    }
+};
+
+// The monitors making up the virtual desktop. Filled from EnumDisplayMonitors on Windows, or from a
+// description like "1920x1080+0+0,2560x1440+1920-200" when running headless.
+// Also counts how often each monitor's surface was presented.
+class MonitorLayout
+{
+public:
+    static const int MAX_MONITORS = 64; // So a set of monitors fits in a uint64_t mask
+
+    void Clear();
+    bool AddMonitor(const ScreenRect &bounds);
+    bool Parse(const std::string &description); // Replaces the current layout
+
+    int GetCount() const { return static_cast<int>(monitors.size()); }
+    const ScreenRect &GetBounds(int monitor) const { return monitors[monitor].bounds; }
+    ScreenRect GetVirtualBounds() const; // Union of all monitors
+    int GetPrimary() const;              // The monitor containing (0, 0), else the first one
+
+    // Bit i is set if rect overlaps monitor i
+    uint64_t GetIntersecting(const ScreenRect &rect) const;
+
+    // rect moved the least it takes to lie on a single monitor: unchanged if it already does, else onto the
+    // monitor it overlaps most, or the nearest one if it's off every monitor
+    ScreenRect MoveOntoMonitor(const ScreenRect &rect) const;
+
+    void CountPresent(int monitor) { monitors[monitor].presents++; }
+    long long GetPresentCount(int monitor) const { return monitors[monitor].presents; }
+
+private:
+    struct Monitor
+    {
+        ScreenRect bounds;
+        long long presents = 0;
+    };
+    std::vector<Monitor> monitors;
+};
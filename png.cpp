@@ -0,0 +1,305 @@
+#include "png.h"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+
+// Larger than any sprite sheet; keeps width * height * 4 well inside size_t and int pixel indices
+const int MAX_DIMENSION = 16384;
+
+// ---- Inflate (RFC 1951) ----
+
+struct BitReader
+{
+    const uint8_t *data;
+    size_t size;
+    size_t pos = 0;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    bool ok = true;
+
+    int Bits(int n) {
+        while (bitCount < n) {
+            if (pos >= size) {
+                ok = false;
+                return 0;
+            }
+            bitBuffer |= static_cast<uint32_t>(data[pos++]) << bitCount;
+            bitCount += 8;
+        }
+        int value = static_cast<int>(bitBuffer & ((1u << n) - 1));
+        bitBuffer >>= n;
+        bitCount -= n;
+        return value;
+    }
+};
+
+// Canonical Huffman code: number of codes per length and symbols ordered by code
+struct Huffman
+{
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+bool BuildHuffman(Huffman &h, const uint8_t *lengths, int n) {
+    std::memset(h.counts, 0, sizeof(h.counts));
+    for (int i = 0; i < n; i++) h.counts[lengths[i]]++;
+    h.counts[0] = 0;
+
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++) offsets[len + 1] = offsets[len] + h.counts[len];
+    for (int i = 0; i < n; i++) {
+        if (lengths[i]) h.symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+    }
+    return true;
+}
+
+int DecodeSymbol(BitReader &br, const Huffman &h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= br.Bits(1);
+        int count = h.counts[len];
+        if (code - count < first) return h.symbols[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Output past limit is an error, so a small crafted stream can't expand without bound
+bool InflateBlock(BitReader &br, std::vector<uint8_t> &out, size_t limit, const Huffman &lit, const Huffman &dist) {
+    for (;;) {
+        int symbol = DecodeSymbol(br, lit);
+        if (!br.ok || symbol < 0) return false;
+        if (symbol < 256) {
+            if (out.size() >= limit) return false;
+            out.push_back(static_cast<uint8_t>(symbol));
+            continue;
+        }
+        if (symbol == 256) return true;
+
+        symbol -= 257;
+        if (symbol >= 29) return false;
+        int length = lengthBase[symbol] + br.Bits(lengthExtra[symbol]);
+        int distSymbol = DecodeSymbol(br, dist);
+        if (!br.ok || distSymbol < 0 || distSymbol >= 30) return false;
+        size_t distance = distBase[distSymbol] + br.Bits(distExtra[distSymbol]);
+        if (!br.ok || distance > out.size() || out.size() + length > limit) return false;
+
+        size_t from = out.size() - distance;
+        for (int i = 0; i < length; i++) out.push_back(out[from + i]);
+    }
+}
+
+bool Inflate(const uint8_t *data, size_t size, size_t limit, std::vector<uint8_t> &out) {
+    BitReader br{ data, size };
+    int last = 0;
+    while (!last) {
+        last = br.Bits(1);
+        int type = br.Bits(2);
+        if (!br.ok) return false;
+
+        if (type == 0) {
+            // Stored block: byte aligned length, then raw bytes
+            br.bitBuffer = 0;
+            br.bitCount = 0;
+            if (br.pos + 4 > size) return false;
+            int len = data[br.pos] | (data[br.pos + 1] << 8);
+            int nlen = data[br.pos + 2] | (data[br.pos + 3] << 8);
+            if ((len ^ 0xFFFF) != nlen) return false;
+            br.pos += 4;
+            if (br.pos + len > size || out.size() + len > limit) return false;
+            out.insert(out.end(), data + br.pos, data + br.pos + len);
+            br.pos += len;
+        } else if (type == 1) {
+            uint8_t lengths[288 + 30];
+            for (int i = 0; i < 144; i++) lengths[i] = 8;
+            for (int i = 144; i < 256; i++) lengths[i] = 9;
+            for (int i = 256; i < 280; i++) lengths[i] = 7;
+            for (int i = 280; i < 288; i++) lengths[i] = 8;
+            for (int i = 0; i < 30; i++) lengths[288 + i] = 5;
+            Huffman lit, dist;
+            BuildHuffman(lit, lengths, 288);
+            BuildHuffman(dist, lengths + 288, 30);
+            if (!InflateBlock(br, out, limit, lit, dist)) return false;
+        } else if (type == 2) {
+            int nlen = br.Bits(5) + 257;
+            int ndist = br.Bits(5) + 1;
+            int ncode = br.Bits(4) + 4;
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            uint8_t codeLengths[19] = {};
+            for (int i = 0; i < ncode; i++) codeLengths[order[i]] = static_cast<uint8_t>(br.Bits(3));
+            Huffman codeHuffman;
+            BuildHuffman(codeHuffman, codeLengths, 19);
+
+            uint8_t lengths[288 + 32] = {};
+            int index = 0;
+            while (index < nlen + ndist) {
+                int symbol = DecodeSymbol(br, codeHuffman);
+                if (!br.ok || symbol < 0) return false;
+                if (symbol < 16) {
+                    lengths[index++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+                int repeat = 0;
+                uint8_t value = 0;
+                if (symbol == 16) {
+                    if (index == 0) return false;
+                    value = lengths[index - 1];
+                    repeat = 3 + br.Bits(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + br.Bits(3);
+                } else {
+                    repeat = 11 + br.Bits(7);
+                }
+                if (index + repeat > nlen + ndist) return false;
+                while (repeat--) lengths[index++] = value;
+            }
+
+            Huffman lit, dist;
+            BuildHuffman(lit, lengths, nlen);
+            BuildHuffman(dist, lengths + nlen, ndist);
+            if (!InflateBlock(br, out, limit, lit, dist)) return false;
+        } else {
+            return false;
+        }
+        if (!br.ok) return false;
+    }
+    return true;
+}
+
+// ---- PNG ----
+
+uint32_t ReadBE32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+int Paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+} // namespace
+
+bool DecodePng(const std::vector<uint8_t>& data, Image& out) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (data.size() < 8 || std::memcmp(data.data(), signature, 8) != 0) return false;
+
+    int width = 0, height = 0, bitDepth = 0, colorType = 0, interlace = 0;
+    std::vector<uint8_t> idat;
+    std::vector<uint32_t> palette; // Straight RGBA
+    size_t pos = 8;
+    while (pos + 12 <= data.size()) {
+        uint32_t length = ReadBE32(&data[pos]);
+        const uint8_t *type = &data[pos + 4];
+        const uint8_t *chunk = &data[pos + 8];
+        if (pos + 12 + length > data.size()) return false;
+
+        if (std::memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            width = static_cast<int>(ReadBE32(chunk));
+            height = static_cast<int>(ReadBE32(chunk + 4));
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            interlace = chunk[12];
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            palette.clear();
+            for (uint32_t i = 0; i + 3 <= length; i += 3) {
+                palette.push_back(0xFF000000u | (chunk[i] << 16) | (chunk[i + 1] << 8) | chunk[i + 2]);
+            }
+        } else if (std::memcmp(type, "tRNS", 4) == 0 && colorType == 3) {
+            for (uint32_t i = 0; i < length && i < palette.size(); i++) {
+                palette[i] = (palette[i] & 0x00FFFFFFu) | (static_cast<uint32_t>(chunk[i]) << 24);
+            }
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), chunk, chunk + length);
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + length;
+    }
+
+    int channels = 0;
+    switch (colorType) {
+        case 0: channels = 1; break; // Grey
+        case 2: channels = 3; break; // RGB
+        case 3: channels = 1; break; // Palette
+        case 4: channels = 2; break; // Grey + alpha
+        case 6: channels = 4; break; // RGBA
+        default: return false;
+    }
+    if (width <= 0 || height <= 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) return false;
+    if (bitDepth != 8 || interlace != 0 || idat.size() < 2) return false;
+
+    // Skip the 2-byte zlib header, we don't check the adler32 trailer. Deflate expands at most 1032:1, so a
+    // header claiming more than the data can hold doesn't get to reserve it, and inflating stops with an
+    // error as soon as the stream holds more than the header says
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    size_t rawBytes = (rowBytes + 1) * static_cast<size_t>(height);
+    std::vector<uint8_t> raw;
+    raw.reserve(std::min(rawBytes, idat.size() * 1032));
+    if (!Inflate(idat.data() + 2, idat.size() - 2, rawBytes, raw)) return false;
+    if (raw.size() < rawBytes) return false;
+
+    // Undo the per-row filters in place
+    std::vector<uint8_t> zeroRow(rowBytes, 0);
+    for (int row = 0; row < height; row++) {
+        uint8_t filter = raw[row * (rowBytes + 1)];
+        uint8_t *cur = &raw[row * (rowBytes + 1) + 1];
+        const uint8_t *prev = row > 0 ? &raw[(row - 1) * (rowBytes + 1) + 1] : zeroRow.data();
+        for (size_t i = 0; i < rowBytes; i++) {
+            int a = i >= static_cast<size_t>(channels) ? cur[i - channels] : 0;
+            int b = prev[i];
+            int c = i >= static_cast<size_t>(channels) ? prev[i - channels] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: cur[i] = static_cast<uint8_t>(cur[i] + a); break;
+                case 2: cur[i] = static_cast<uint8_t>(cur[i] + b); break;
+                case 3: cur[i] = static_cast<uint8_t>(cur[i] + ((a + b) >> 1)); break;
+                case 4: cur[i] = static_cast<uint8_t>(cur[i] + Paeth(a, b, c)); break;
+                default: return false;
+            }
+        }
+    }
+
+    out.width = width;
+    out.height = height;
+    out.pixels.resize(static_cast<size_t>(width) * height);
+    for (int row = 0; row < height; row++) {
+        const uint8_t *src = &raw[row * (rowBytes + 1) + 1];
+        for (int col = 0; col < width; col++) {
+            uint32_t r, g, b, a;
+            const uint8_t *p = src + static_cast<size_t>(col) * channels;
+            switch (colorType) {
+                case 0: r = g = b = p[0]; a = 255; break;
+                case 2: r = p[0]; g = p[1]; b = p[2]; a = 255; break;
+                case 3: {
+                    uint32_t entry = p[0] < palette.size() ? palette[p[0]] : 0xFF000000u;
+                    a = entry >> 24; r = (entry >> 16) & 0xFF; g = (entry >> 8) & 0xFF; b = entry & 0xFF;
+                    break;
+                }
+                case 4: r = g = b = p[0]; a = p[1]; break;
+                default: r = p[0]; g = p[1]; b = p[2]; a = p[3]; break;
+            }
+            // Premultiply with rounding
+            r = (r * a + 127) / 255;
+            g = (g * a + 127) / 255;
+            b = (b * a + 127) / 255;
+            out.pixels[static_cast<size_t>(row) * width + col] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+    return true;
+}
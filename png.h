@@ -0,0 +1,8 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "image.h"
+
+// Minimal PNG decoder for the headless build: 8-bit greyscale, RGB, palette and RGBA, non-interlaced.
+// Output is premultiplied BGRA like everything else that goes through Image.
+bool DecodePng(const std::vector<uint8_t>& data, Image& out);
@@ -0,0 +1,97 @@
+#include "renderTarget.h"
+
+RenderTarget::~RenderTarget()
+{
+    Release();
+}
+
+bool RenderTarget::Resize(int w, int h) {
+    if (hBitmap && w == width && h == height) return true;
+    Release();
+    if (w <= 0 || h <= 0) return false;
+
+    HDC hdcScreen = ::GetDC(nullptr);
+    hdcMem = CreateCompatibleDC(hdcScreen);
+    ReleaseDC(nullptr, hdcScreen);
+
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = w;
+    bmi.bmiHeader.biHeight = -h; // Top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hBitmap = CreateDIBSection(hdcMem, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+    if (!hBitmap) {
+        Release();
+        return false;
+    }
+    oldBitmap = SelectObject(hdcMem, hBitmap);
+    graphics = new Gdiplus::Graphics(hdcMem);
+
+    width = w;
+    height = h;
+    allocationCount++;
+    return true;
+}
+
+void RenderTarget::Release() {
+    delete graphics;
+    graphics = nullptr;
+    wrappedBitmaps.clear();
+
+    if (hdcMem && oldBitmap) SelectObject(hdcMem, oldBitmap);
+    if (hBitmap) DeleteObject(hBitmap);
+    if (hdcMem) DeleteDC(hdcMem);
+
+    hdcMem = nullptr;
+    hBitmap = nullptr;
+    oldBitmap = nullptr;
+    bits = nullptr;
+    width = height = 0;
+}
+
+Gdiplus::Bitmap *RenderTarget::GetBitmap(const ImageView &image) {
+    // Keyed by pixel address: a rebuilt frame cache may reuse an address, but then
+    // the wrapper still points at the right memory as long as the layout matches
+    WrappedBitmap &wrapped = wrappedBitmaps[image.pixels];
+    if (!wrapped.bitmap || wrapped.width != image.width || wrapped.height != image.height ||
+        wrapped.stride != image.stride) {
+        wrapped.width = image.width;
+        wrapped.height = image.height;
+        wrapped.stride = image.stride;
+        BYTE *scan0 = reinterpret_cast<BYTE *>(const_cast<uint32_t *>(image.pixels));
+        wrapped.bitmap = std::make_unique<Gdiplus::Bitmap>(image.width, image.height, image.stride * 4,
+                                                           PixelFormat32bppPARGB, scan0);
+    }
+    return wrapped.bitmap.get();
+}
+
+void RenderTarget::Present(HWND hwnd, POINT dst) {
+    if (!hBitmap) return;
+
+    SIZE wndSize = { width, height };
+    POINT srcPt = { 0, 0 };
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    // A null screen DC is fine here, UpdateLayeredWindow falls back to the default palette
+    UpdateLayeredWindow(hwnd, nullptr, &dst, &wndSize, hdcMem, &srcPt, 0, &blend, ULW_ALPHA);
+    frameCount++;
+    pixelsPushed += static_cast<long long>(width) * height;
+}
+
+void GdiplusRenderer::Clear() {
+    target.GetGraphics()->Clear(Gdiplus::Color(0, 0, 0, 0)); // Transparent background
+}
+
+void GdiplusRenderer::DrawImage(const ImageView &image, int x, int y, bool mirror) {
+    if (image.Empty()) return;
+    // Same size as the destination, so this is an unscaled copy. A negative width flips it.
+    int left = x - origin.x;
+    int top = y - origin.y;
+    if (mirror) {
+        target.GetGraphics()->DrawImage(target.GetBitmap(image), left + image.width, top, -image.width, image.height);
+    } else {
+        target.GetGraphics()->DrawImage(target.GetBitmap(image), left, top, image.width, image.height);
+    }
+}
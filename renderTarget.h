@@ -0,0 +1,76 @@
+#pragma once
+#include <windows.h>
+#include <gdiplus.h>
+#include <memory>
+#include <unordered_map>
+#include "renderer.h"
+
+// Long-lived back buffer for the layered window.
+// Owns the 32bpp DIB section, the memory DC it's selected into and the GDI+
+// Graphics wrapping that DC, so a frame only has to clear and draw into it.
+// The buffer is only reallocated when the requested size changes (e.g. on WM_DISPLAYCHANGE).
+class RenderTarget
+{
+public:
+    RenderTarget() = default;
+    ~RenderTarget();
+
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    bool Resize(int w, int h); // No-op if the size is unchanged
+    void Release();
+
+    // GDI+ bitmap wrapping an image's pixels without copying, created once per image
+    Gdiplus::Bitmap *GetBitmap(const ImageView &image);
+
+    // Pushes the whole buffer to the layered window with its top-left at dst
+    void Present(HWND hwnd, POINT dst);
+
+    Gdiplus::Graphics *GetGraphics() const { return graphics; }
+    HDC GetDC() const { return hdcMem; }
+    void *GetBits() const { return bits; }
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+    // How many times the DIB has been (re)allocated, how many frames were presented
+    // and how many pixels UpdateLayeredWindow had to compose
+    int GetAllocationCount() const { return allocationCount; }
+    int GetFrameCount() const { return frameCount; }
+    long long GetPixelsPushed() const { return pixelsPushed; }
+    int GetLastFramePixels() const { return width * height; }
+
+private:
+    HDC hdcMem = nullptr;
+    HBITMAP hBitmap = nullptr;
+    HGDIOBJ oldBitmap = nullptr;
+    void *bits = nullptr;
+    Gdiplus::Graphics *graphics = nullptr;
+
+    struct WrappedBitmap
+    {
+        int width = 0, height = 0, stride = 0;
+        std::unique_ptr<Gdiplus::Bitmap> bitmap;
+    };
+    std::unordered_map<const uint32_t *, WrappedBitmap> wrappedBitmaps;
+
+    int width = 0, height = 0;
+    int allocationCount = 0;
+    int frameCount = 0;
+    long long pixelsPushed = 0;
+};
+
+// GDI+ backend drawing into a RenderTarget, for when the software blitter is switched off
+class GdiplusRenderer : public Renderer
+{
+public:
+    // origin is the screen position of the target's top-left corner
+    GdiplusRenderer(RenderTarget &target, POINT origin) : target(target), origin(origin) {}
+
+    void Clear() override;
+    void DrawImage(const ImageView &image, int x, int y, bool mirror) override;
+
+private:
+    RenderTarget &target;
+    POINT origin;
+};
@@ -0,0 +1,56 @@
+#include "renderer.h"
+#include <fstream>
+
+void SurfaceRenderer::Clear() {
+    ClearSurface(surface);
+}
+
+void SurfaceRenderer::DrawImage(const ImageView &image, int x, int y, bool mirror) {
+    if (image.Empty()) return;
+    BlendImage(surface, x, y, image.pixels, image.width, image.height, image.stride, mirror);
+}
+
+void SurfaceRenderer::DrawImageSpans(const ImageView &image, const AlphaSpans &spans, int x, int y, bool mirror) {
+    if (!useAlphaSpans || spans.width != image.width || spans.height != image.height) {
+        DrawImage(image, x, y, mirror);
+        return;
+    }
+    BlendImageSpans(surface, x, y, image.pixels, image.stride, spans, mirror);
+}
+
+HeadlessRenderer::HeadlessRenderer(int w, int h) {
+    Resize(w, h);
+}
+
+void HeadlessRenderer::Resize(int w, int h) {
+    if (w == surface.width && h == surface.height && !buffer.empty()) return;
+    buffer.assign(static_cast<size_t>(w) * h, 0);
+    allocationCount++;
+    surface.pixels = buffer.data();
+    surface.width = surface.stride = w;
+    surface.height = h;
+}
+
+void HeadlessRenderer::SetOrigin(int x, int y) {
+    surface.originX = x;
+    surface.originY = y;
+}
+
+bool HeadlessRenderer::WritePpm(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    file << "P6\n" << surface.width << " " << surface.height << "\n255\n";
+    std::vector<char> row(static_cast<size_t>(surface.width) * 3);
+    for (int y = 0; y < surface.height; y++) {
+        const uint32_t *src = surface.pixels + static_cast<size_t>(y) * surface.stride;
+        for (int x = 0; x < surface.width; x++) {
+            // Premultiplied colour is already the result of blending over black
+            row[x * 3 + 0] = static_cast<char>((src[x] >> 16) & 0xFF);
+            row[x * 3 + 1] = static_cast<char>((src[x] >> 8) & 0xFF);
+            row[x * 3 + 2] = static_cast<char>(src[x] & 0xFF);
+        }
+        file.write(row.data(), row.size());
+    }
+    return file.good();
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "blitter.h"
+#include "image.h"
+
+// What Sprite draws through, so the core doesn't care whether pixels end up in GDI+,
+// a DIB section or a plain memory buffer. Coordinates are screen coordinates.
+class Renderer
+{
+public:
+    virtual ~Renderer() = default;
+
+    virtual void Clear() = 0;
+    // Draws a premultiplied image unscaled with its top-left at (x, y), flipped horizontally if mirror is set
+    virtual void DrawImage(const ImageView &image, int x, int y, bool mirror) = 0;
+    // Same, with the image's alpha spans so transparent pixels can be skipped. Backends that can't use them draw the whole image.
+    virtual void DrawImageSpans(const ImageView &image, const AlphaSpans &spans, int x, int y, bool mirror) {
+        DrawImage(image, x, y, mirror);
+    }
+};
+
+// How many ticks ended in a present and how many were skipped because nothing visible changed
+struct PresentStats
+{
+    long long presented = 0;
+    long long skipped = 0;
+};
+
+// CPU backend: blends into a Surface with the SIMD blitter
+class SurfaceRenderer : public Renderer
+{
+public:
+    explicit SurfaceRenderer(const Surface &target) : surface(target) {}
+
+    void Clear() override;
+    void DrawImage(const ImageView &image, int x, int y, bool mirror) override;
+    void DrawImageSpans(const ImageView &image, const AlphaSpans &spans, int x, int y, bool mirror) override;
+
+    const Surface &GetSurface() const { return surface; }
+    // Off blends the whole rectangle even when spans are given (to compare the two)
+    void SetUseAlphaSpans(bool use) { useAlphaSpans = use; }
+
+protected:
+    SurfaceRenderer() = default;
+    Surface surface;
+    bool useAlphaSpans = true;
+};
+
+// Headless backend that owns its buffer, for running and profiling without any window
+class HeadlessRenderer : public SurfaceRenderer
+{
+public:
+    HeadlessRenderer(int w, int h);
+
+    void Resize(int w, int h); // Keeps the buffer if the size is unchanged
+    void SetOrigin(int x, int y);
+
+    // Dumps the buffer as a binary PPM, composited over black
+    bool WritePpm(const std::string &path) const;
+
+    // How many times the buffer has been (re)allocated, like RenderTarget's
+    int GetAllocationCount() const { return allocationCount; }
+
+private:
+    std::vector<uint32_t> buffer;
+    int allocationCount = 0;
+};
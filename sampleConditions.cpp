@@ -0,0 +1,34 @@
+// Sample condition plugin (see conditionPlugin.h). Built on its own, as sampleConditions.dll by
+// `nmake sampleConditions.dll` or sampleConditions.so by `make -f headless.mk sampleConditions.so`;
+// main.exe loads every plugin in plugins/.
+//
+//   nearMiddle  the sprite's centre is within a tenth of the screen width of the world's middle
+//   onFloor     its bottom edge touches the bottom of the world
+//   lingered    it's been in its current state for 5 seconds
+#include "conditionPlugin.h"
+
+namespace {
+
+int NearMiddle(const ConditionInputs *in, void *) {
+    float centre = in->x + in->width / 2;
+    float middle = in->left + in->screenW / 2;
+    return centre > middle - in->screenW / 10 && centre < middle + in->screenW / 10;
+}
+
+int OnFloor(const ConditionInputs *in, void *) {
+    return in->y + in->height >= in->top + in->screenH;
+}
+
+int Lingered(const ConditionInputs *in, void *) {
+    return in->elapsed >= 5000;
+}
+
+}
+
+CONDITION_PLUGIN_EXPORT int RegisterConditions(const ConditionHost *host) {
+    if (host->version != CONDITION_PLUGIN_VERSION) return 1;
+    int failed = host->registerCondition(host->registry, "nearMiddle", NearMiddle, CONDITION_EVENT_POSITION, nullptr);
+    failed |= host->registerCondition(host->registry, "onFloor", OnFloor, CONDITION_EVENT_POSITION, nullptr);
+    failed |= host->registerCondition(host->registry, "lingered", Lingered, CONDITION_EVENT_STEP, nullptr);
+    return failed;
+}
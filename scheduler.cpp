@@ -0,0 +1,19 @@
+#include "scheduler.h"
+#include <algorithm>
+
+void Deadline::Add(uint32_t t) {
+    // Signed difference so this keeps working across the 32-bit wrap
+    if (!pending || static_cast<int32_t>(t - time) < 0) time = t;
+    pending = true;
+}
+
+uint32_t TickScheduler::GetDelay(const Deadline &deadline, uint32_t now) const {
+    uint32_t delay = NO_WAKEUP;
+    if (deadline.pending) {
+        int32_t untilDeadline = static_cast<int32_t>(deadline.time - now);
+        delay = static_cast<uint32_t>(std::max(untilDeadline, 0)); // Overdue: tick right away
+    }
+    // Only continuous movement needs the fixed rate
+    if (deadline.continuous) delay = std::min(delay, fixedIntervalMs);
+    return delay;
+}
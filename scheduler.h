@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include "clock.h"
+
+// When the simulation next needs a tick, as reported by Sprite::GetNextDeadline
+struct Deadline
+{
+    bool pending = false;    // false: nothing will change until input arrives
+    uint32_t time = 0;       // Tick count of the earliest pending change
+    bool continuous = false; // Moving, so it needs ticking at the fixed rate
+
+    void Add(uint32_t t); // Keeps the earlier of the current and the new deadline
+};
+
+// Turns deadlines into how long the main loop may sleep, instead of waking at a fixed rate.
+// Works on plain tick counts, so it runs headless against a fake clock just as well.
+class TickScheduler
+{
+public:
+    static const uint32_t NO_WAKEUP = 0xFFFFFFFF;
+
+    explicit TickScheduler(uint32_t fixedIntervalMs = 16) : fixedIntervalMs(fixedIntervalMs) {}
+
+    // Milliseconds to wait after now before the next tick, or NO_WAKEUP if nothing is pending
+    uint32_t GetDelay(const Deadline &deadline, uint32_t now) const;
+
+    uint32_t GetFixedInterval() const { return fixedIntervalMs; }
+
+private:
+    uint32_t fixedIntervalMs;
+};
@@ -0,0 +1,216 @@
+// State machine compiler: checks stateMachine.json against the animations folder and writes the
+// precompiled form Sprite::LoadStateMachine reads without any JSON parsing. Run from the repo root.
+//
+//   smc [--animations folder] [--plugin path]... [--plugins folder] [--check | --header] stateMachine.json [stateMachine.bin | stateTables.h]
+//
+// Missing animations and transitions to unknown states or with unknown conditions are errors: the
+// exit code is 1 and nothing is written. Unreachable states, parent transitions that every nested
+// state overrides and transitions that can never be taken are warnings. --check only reports,
+// without writing anything. --header writes the tables and the animations as a C++ header of
+// constexpr arrays instead, for builds with the behaviour compiled in (KIOSK_BUILD, see
+// Sprite::LoadStateTables). Conditions from plugins (see conditionPlugin.h) are only known with
+// --plugin, or --plugins for every plugin in a folder like main.exe loads them from plugins\;
+// the program running the result has to load the same ones.
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include "stateMachine.h"
+#include "conditionRegistry.h"
+#include "nlohmann/json.hpp"
+namespace fs = std::filesystem;
+
+namespace {
+
+void PrintUsage() {
+    std::cerr << "Usage: smc [--animations folder] [--plugin path]... [--plugins folder] [--check | --header] stateMachine.json [stateMachine.bin | stateTables.h]" << std::endl;
+}
+
+// The animation files Sprite::LoadAnimations would load, by name
+std::map<std::string, nlohmann::json> ReadAnimations(const std::string &folder) {
+    std::map<std::string, nlohmann::json> animations;
+    std::error_code error;
+    for (const auto &entry : fs::directory_iterator(folder, error)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".json") continue;
+        std::ifstream file(entry.path());
+        try {
+            nlohmann::json j;
+            file >> j;
+            animations.emplace(j["name"].get<std::string>(), j);
+        } catch (const std::exception &e) {
+            std::cerr << entry.path().string() << ": " << e.what() << std::endl;
+        }
+    }
+    if (error) std::cerr << "Can't read " << folder << ": " << error.message() << std::endl;
+    return animations;
+}
+
+// C++ source for the generated header
+
+const char *const CONDITION_ENUMERATORS[] = { "AtEndOfScreen", "AtStartOfScreen", "RandomInterval", "SetInterval", "OnClick", "AnimationEnd", "Expression", "Plugin" };
+
+std::string FloatLiteral(float value) {
+    std::ostringstream out;
+    out.precision(9); // Enough to read back the same float
+    out << value;
+    std::string text = out.str();
+    if (text.find_first_of(".e") == std::string::npos) text += ".0";
+    return text + "f";
+}
+
+std::string StringLiteral(const std::string &text) {
+    std::string literal = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') literal += '\\';
+        literal += c;
+    }
+    return literal + "\"";
+}
+
+// One constexpr std::array of records, each written by writeRecord
+template <typename T, typename Write>
+void WriteArray(std::ostream &out, const std::string &type, const std::string &name, const std::vector<T> &records, Write writeRecord) {
+    out << "    static constexpr std::array<" << type << ", " << records.size() << "> " << name;
+    if (records.empty()) {
+        out << "{};\n";
+        return;
+    }
+    out << "{{\n";
+    for (const T &record : records) {
+        out << "        { ";
+        writeRecord(record);
+        out << " },\n";
+    }
+    out << "    }};\n";
+}
+
+bool WriteHeader(const StateMachine &machine, const std::map<std::string, nlohmann::json> &animations,
+                 const std::string &source, const std::string &path) {
+    std::ostringstream out;
+    out << "// Generated by smc --header from " << source << " and its animations, don't edit.\n"
+        << "// Load it with Sprite::LoadStateTables<StateTables>().\n"
+        << "#pragma once\n#include <array>\n#include \"compiledTables.h\"\n\nstruct StateTables\n{\n";
+
+    WriteArray(out, "StateMachine::State", "states", machine.states, [&](const StateMachine::State &state) {
+        out << state.animation << ", " << state.firstTransition << ", " << state.transitionCount << ", "
+            << state.firstGroup << ", " << state.groupCount << ", " << static_cast<int>(state.events) << ", {}";
+    });
+    WriteArray(out, "StateMachine::Region", "regions", machine.regions, [&](const StateMachine::Region &region) {
+        out << region.initial << ", " << region.firstState << ", " << region.stateCount;
+    });
+    WriteArray(out, "StateMachine::ConditionGroup", "groups", machine.groups, [&](const StateMachine::ConditionGroup &group) {
+        out << "Condition::" << CONDITION_ENUMERATORS[static_cast<int>(group.condition)] << ", " << static_cast<int>(group.events)
+            << ", {}, " << group.first << ", " << group.count << ", " << group.expression << ", " << group.plugin;
+    });
+    WriteArray(out, "StateMachine::Transition", "transitions", machine.transitions, [&](const StateMachine::Transition &transition) {
+        out << transition.to << ", Condition::" << CONDITION_ENUMERATORS[static_cast<int>(transition.condition)] << ", {}, "
+            << FloatLiteral(transition.probability) << ", " << transition.intervalMin << ", " << transition.intervalMax << ", "
+            << transition.intervalSet << ", " << transition.expression << ", " << transition.plugin;
+    });
+    WriteArray(out, "AliasEntry", "aliases", machine.aliases, [&](const AliasEntry &entry) {
+        out << FloatLiteral(entry.probability) << ", " << entry.alias;
+    });
+    WriteArray(out, "ExpressionProgram", "expressions", machine.expressions, [&](const ExpressionProgram &program) {
+        out << program.firstInstruction << ", " << program.instructionCount << ", " << program.firstConstant << ", "
+            << program.constantCount << ", " << static_cast<int>(program.events) << ", {}";
+    });
+    WriteArray(out, "ExpressionInstruction", "expressionCode", machine.expressionCode, [&](const ExpressionInstruction &instruction) {
+        out << "static_cast<ExpressionOp>(" << static_cast<int>(instruction.op) << "), " << static_cast<int>(instruction.dst) << ", "
+            << static_cast<int>(instruction.a) << ", " << static_cast<int>(instruction.b) << ", " << instruction.operand;
+    });
+    WriteArray(out, "float", "expressionConstants", machine.expressionConstants, [&](float constant) { out << FloatLiteral(constant); });
+    WriteArray(out, "const char *", "stateNames", machine.stateNames, [&](const std::string &name) { out << StringLiteral(name); });
+    WriteArray(out, "const char *", "animationNames", machine.animationNames, [&](const std::string &name) { out << StringLiteral(name); });
+    WriteArray(out, "const char *", "pluginNames", machine.pluginNames, [&](const std::string &name) { out << StringLiteral(name); });
+
+    // Every animation, as Sprite::LoadAnimation reads them; velocities given per tick ("dx"/"dy")
+    // are converted the same way
+    std::vector<std::string> animationSources, frameSources;
+    for (const auto &[name, j] : animations) {
+        // at() throws on a missing key where operator[] on a const json would assert
+        try {
+            auto velocity = [&](const char *perSecond, const char *perTick) {
+                const auto &movement = j.contains("movement") ? j.at("movement") : nlohmann::json::object();
+                if (movement.contains(perSecond)) return FloatLiteral(movement.at(perSecond).get<float>());
+                return FloatLiteral(movement.value(perTick, 0.0f)) + " * 1000.0f / Sprite::SIM_STEP_MS";
+            };
+            size_t firstFrame = frameSources.size();
+            if (!j.contains("mirrorOf")) {
+                for (const auto &frame : j.at("frames")) {
+                    frameSources.push_back(StringLiteral(frame.at("image").get<std::string>()) + ", " + std::to_string(frame.at("duration").get<int>()));
+                }
+            }
+            animationSources.push_back(StringLiteral(name) + ", " + (j.contains("mirrorOf") ? StringLiteral(j.at("mirrorOf").get<std::string>()) : "nullptr") + ", " +
+                                       (j.value("loop", true) ? "true" : "false") + ", " + velocity("vx", "dx") + ", " + velocity("vy", "dy") + ", " +
+                                       std::to_string(firstFrame) + ", " + std::to_string(frameSources.size() - firstFrame));
+        } catch (const std::exception &e) {
+            std::cerr << "Can't compile animation " << name << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+    auto writeSource = [&](const std::string &record) { out << record; };
+    WriteArray(out, "Sprite::AnimationSource", "animations", animationSources, writeSource);
+    WriteArray(out, "Sprite::FrameSource", "animationFrames", frameSources, writeSource);
+    out << "};\n";
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    file << out.str();
+    return static_cast<bool>(file);
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::string animationFolder = "animations";
+    bool checkOnly = false, header = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--animations" && i + 1 < argc) {
+            animationFolder = argv[++i];
+        } else if (arg == "--plugin" && i + 1 < argc) {
+            if (!ConditionRegistry::Global().LoadPlugin(argv[++i])) return 1;
+        } else if (arg == "--plugins" && i + 1 < argc) {
+            ConditionRegistry::Global().LoadPlugins(argv[++i]); // None there is fine
+        } else if (arg == "--check") {
+            checkOnly = true;
+        } else if (arg == "--header") {
+            header = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (paths.size() != (checkOnly ? 1u : 2u) || (checkOnly && header)) {
+        PrintUsage();
+        return 1;
+    }
+
+    StateMachine machine;
+    bool compiled = machine.LoadJson(paths[0], &ConditionRegistry::Global());
+    std::map<std::string, nlohmann::json> animations = ReadAnimations(animationFolder);
+    std::vector<std::string> animationNames;
+    for (const auto &animation : animations) animationNames.push_back(animation.first);
+    int errors = machine.Validate(animationNames, std::cerr) + (compiled ? 0 : 1);
+    std::cerr << paths[0] << ": " << machine.states.size() << " states, " << machine.groups.size() << " condition groups, "
+              << machine.transitions.size() << " transitions" << std::endl;
+    if (errors > 0) {
+        std::cerr << "Not compiled, fix the errors above" << std::endl;
+        return 1;
+    }
+    if (checkOnly) return 0;
+
+    if (header ? !WriteHeader(machine, animations, paths[0], paths[1]) : !machine.SaveBinary(paths[1])) return 1;
+    std::cerr << "Wrote " << paths[1] << " (" << fs::file_size(paths[1]) << " bytes)" << std::endl;
+    return 0;
+}
@@ -1,67 +1,80 @@
 #include "sprite.h"
+#include "compiledTables.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <filesystem>
+#include <cmath>
+#include <algorithm>
 namespace fs = std::filesystem;
 #include "nlohmann/json.hpp"
 using json = nlohmann::json;
-using namespace Gdiplus;
 
-Sprite::Sprite(int screenW, int screenH) : screenWidth(screenW), screenHeight(screenH) {}
+Sprite::Sprite(int screenW, int screenH, const Clock &clock)
+  : screenWidth(screenW), screenHeight(screenH), clock(clock), currentTime(clock.NowMs()), lastStepTime(currentTime),
+    timers(currentTime) {}
 
-Sprite::~Sprite()
-{
-  for (auto &frame : currentFrames)
-  {
-    delete frame.image;
-  }
+bool Sprite::LoadStateMachine(const std::string& stateMachinePath) {
+  StopStateMachine();
+  machine.Load(stateMachinePath, &ConditionRegistry::Global());
+  checkTransition = &Sprite::CheckTransition;
+  return StartStateMachine();
 }
 
-void Sprite::LoadStateMachine(const std::wstring& stateMachinePath) {
-  std::ifstream file(stateMachinePath);
-  if (!file.is_open()) {
-      std::cerr << "Failed to open state machine file" << std::endl;
-      return;
-  }
-
-  nlohmann::ordered_json j;
-  file >> j;
-  bool firstState = true;
+void Sprite::StopStateMachine() {
+  for (size_t r = 0; r < activeRegions.size(); r++) LeaveState(static_cast<int>(r));
+  activeStates.clear();
+  activeRegions.clear();
+  stateAnimations.clear();
+}
 
-  for (auto& state : j.items()) {
-    const auto& stateName = state.key();
-    const auto& stateData = state.value();
+bool Sprite::StartStateMachine() {
+  if (machine.states.empty()) return false;
 
-    State newState;
-    newState.animation = stateData["animation"];
-    
-    // Load transitions
-    for (const auto& transition : stateData["transitions"]) {
-        Transition newTransition;
-        newTransition.to = transition["to"];
-        newTransition.condition = transition["condition"];
-        if (transition.contains("probability")) {
-          newTransition.probability = transition["probability"];
-        }
-        if (transition.contains("intervalMin") && transition.contains("intervalMax")) {
-          newTransition.intervalMin = transition["intervalMin"];
-          newTransition.intervalMax = transition["intervalMax"];
-        }
-        if (transition.contains("intervalSet")) {
-          newTransition.intervalSet = transition["intervalSet"];
-        }
-        newState.transitions.push_back(newTransition);
+  // Names only matter while loading, everything after works on indices
+  for (size_t i = 0; i < machine.states.size(); i++) {
+    if (machine.states[i].animation < 0) {
+      stateAnimations.push_back(nullptr);
+      continue;
+    }
+    const std::string& animationName = machine.animationNames[machine.states[i].animation];
+    auto animationIt = loadedAnimations.find(animationName);
+    if (animationIt != loadedAnimations.end()) {
+      stateAnimations.push_back(&animationIt->second);
+    } else {
+      std::cerr << "State " << machine.stateNames[i] << ": no loaded animation " << animationName << std::endl;
+      stateAnimations.push_back(nullptr);
     }
+  }
 
-    stateMachine[stateName] = newState;
+  // Conditions from plugins are called straight through the registered function from now on
+  pluginConditions.clear();
+  for (const std::string& name : machine.pluginNames) {
+    const ConditionRegistry::Entry* entry = ConditionRegistry::Global().Find(name);
+    if (!entry) std::cerr << "Condition " << name << " isn't registered, it never holds" << std::endl;
+    pluginConditions.push_back(entry);
+  }
+  // Which events a plugin condition waits on is up to the plugin loaded now, not whatever smc saw when it
+  // compiled the tables, so those groups and the masks of their states are taken from the registry again
+  for (auto& group : machine.groups) {
+    if (group.condition != Condition::Plugin) continue;
+    const ConditionRegistry::Entry* entry = pluginConditions[group.plugin];
+    group.events = entry ? entry->events : 0;
+  }
+  for (auto& state : machine.states) {
+    state.events = 0;
+    for (int g = state.firstGroup; g < state.firstGroup + state.groupCount; g++) state.events |= machine.groups[g].events;
+  }
 
-    // Apply the animation of the first state as default
-    if (firstState) {
-      ApplyAnimation(newState.animation);
-      firstState = false;
-    }
+  // Every region starts in its initial state
+  activeStates.assign(machine.regions.size(), -1);
+  activeRegions.assign(machine.regions.size(), ActiveRegion());
+  timerExpired.assign(machine.transitions.size(), false);
+  expiredCount = 0;
+  for (size_t r = 0; r < machine.regions.size(); r++) {
+    EnterState(static_cast<int>(r), machine.regions[r].initial);
   }
+  return true;
 }
 
 void Sprite::LoadAnimations(const std::string& folder) {
@@ -77,15 +90,18 @@ void Sprite::LoadAnimations(const std::string& folder) {
         try {
             file >> j;
             std::string animationName = j["name"];  // read the "name" field
-            LoadAnimation(animationName, entry.path());
+            LoadAnimation(animationName, entry.path().string());
         } catch (const std::exception& e) {
             std::cerr << "Error loading animation: " << e.what() << std::endl;
         }
     }
   }
+
+  // Mirrors can only be built once the animations they point at are loaded
+  ResolveMirroredAnimations();
 }
 
-void Sprite::LoadAnimation(const std::string& animationName, const std::wstring& animationPath) 
+void Sprite::LoadAnimation(const std::string& animationName, const std::string& animationPath) 
 {
   if (loadedAnimations.find(animationName) != loadedAnimations.end()) {
     return; // If animation is already loaded, no need to load again
@@ -101,199 +117,614 @@ void Sprite::LoadAnimation(const std::string& animationName, const std::wstring&
   file >> j;
 
   std::vector<Frame> frames;
-  for (const auto& frameData : j["frames"])
-  {
-    Frame frame;
-    try {
-      std::string imagePathStr = frameData["image"];
-      std::wstring imagePath(imagePathStr.begin(), imagePathStr.end());
-
-      frame.image = new Gdiplus::Image(imagePath.c_str());
-    } catch (const std::exception& e) {
-      std::cerr << "Failed to load image: " << e.what() << std::endl;
+  if (j.contains("mirrorOf")) {
+    // Frames come from the source animation, drawn flipped (see ResolveMirroredAnimations)
+    mirrorSources[animationName] = j["mirrorOf"];
+  } else {
+    for (const auto& frameData : j["frames"])
+    {
+      Frame frame;
+      try {
+        frame.imageIndex = LoadFrameImage(frameData["image"]);
+      } catch (const std::exception& e) {
+        std::cerr << "Failed to load image: " << e.what() << std::endl;
+      }
+      frame.durationMs = frameData["duration"];
+      frames.push_back(frame);
     }
-    frame.durationMs = frameData["duration"];
-    frames.push_back(frame);
   }
 
   // Save the loaded frames into the map
-  loadedAnimations[animationName] = frames;
+  Animation& animation = loadedAnimations[animationName];
+  animation.frames = frames;
+  animation.loop = j.value("loop", true);
+  animation.BuildTimeline();
+
+  // Velocity in pixels per second. Older files give "dx"/"dy" in pixels per 16ms tick instead.
+  // Fractional steps are drawn through the sub-pixel phase cache.
+  const auto& movement = j["movement"];
+  animation.vx = movement.contains("vx") ? movement["vx"].get<float>() : movement.value("dx", 0.0f) * 1000.0f / SIM_STEP_MS;
+  animation.vy = movement.contains("vy") ? movement["vy"].get<float>() : movement.value("dy", 0.0f) * 1000.0f / SIM_STEP_MS;
+}
+
+void Sprite::LoadAnimation(const AnimationSource& source, const FrameSource* frames)
+{
+  if (loadedAnimations.find(source.name) != loadedAnimations.end()) {
+    return;
+  }
+
+  Animation& animation = loadedAnimations[source.name];
+  if (source.mirrorOf) {
+    mirrorSources[source.name] = source.mirrorOf;
+  } else {
+    for (int i = 0; i < source.frameCount; i++) {
+      Frame frame;
+      frame.imageIndex = LoadFrameImage(frames[i].image);
+      frame.durationMs = frames[i].durationMs;
+      animation.frames.push_back(frame);
+    }
+  }
+  animation.loop = source.loop;
+  animation.BuildTimeline();
+  animation.vx = source.vx;
+  animation.vy = source.vy;
+}
+
+void Sprite::ResolveMirroredAnimations()
+{
+  for (const auto& [animationName, sourceName] : mirrorSources) {
+    auto& animation = loadedAnimations[animationName];
+    if (!animation.frames.empty()) continue; // Already resolved
+
+    auto sourceIt = loadedAnimations.find(sourceName);
+    if (sourceIt == loadedAnimations.end() || sourceIt->second.frames.empty() || mirrorSources.count(sourceName)) {
+      std::cerr << "Can't mirror " << animationName << ": no loaded animation " << sourceName << std::endl;
+      continue;
+    }
 
-  int dx = j["movement"]["dx"];
-  int dy = j["movement"]["dy"];
-  animationMovements[animationName] = { dx, dy };
+    // Same images and timings, no pixels copied
+    animation.frames = sourceIt->second.frames;
+    for (auto& frame : animation.frames) {
+      frame.mirrored = !frame.mirrored;
+    }
+    animation.BuildTimeline();
+  }
 }
 
-void Sprite::ApplyAnimation(const std::string& animationName) {
-  if (loadedAnimations.find(animationName) == loadedAnimations.end()) return;
+void Sprite::Animation::BuildTimeline()
+{
+  frameEnds.clear();
+  uint32_t end = 0;
+  for (const auto& frame : frames) {
+    end += static_cast<uint32_t>(std::max(frame.durationMs, 0));
+    frameEnds.push_back(end);
+  }
+}
 
-  currentAnimation = animationName;
-  currentFrames = loadedAnimations[animationName];
-  currentFrame = 0;
-  lastUpdateTime = GetTickCount();
-  animationStartTimes[currentAnimation] = lastUpdateTime;  // Track animation start time
+int Sprite::Animation::FrameAt(uint32_t elapsed) const
+{
+  if (frameEnds.empty() || frameEnds.back() == 0) return 0;
+  uint32_t total = frameEnds.back();
+  if (elapsed >= total) {
+    if (!loop) return static_cast<int>(frames.size()) - 1;
+    elapsed %= total;
+  }
+  // First frame still running at elapsed
+  return static_cast<int>(std::upper_bound(frameEnds.begin(), frameEnds.end(), elapsed) - frameEnds.begin());
+}
 
-  auto movementIt = animationMovements.find(animationName);
-  if (movementIt != animationMovements.end()) {
-      movementX = movementIt->second.first;
-      movementY = movementIt->second.second;
+bool Sprite::Animation::NextFrameChange(uint32_t elapsed, uint32_t &changeAt) const
+{
+  if (frames.size() < 2 || frameEnds.back() == 0) return false;
+  uint32_t total = frameEnds.back();
+  if (!loop && elapsed >= frameEnds[frames.size() - 2]) return false; // On the last frame for good
+
+  uint32_t cycleStart = elapsed - elapsed % total;
+  changeAt = cycleStart + frameEnds[FrameAt(elapsed)];
+  return true;
+}
+
+size_t Sprite::GetMirrorSavedBytes() const
+{
+  std::map<int, size_t> savedPerImage;
+  for (const auto& [animationName, sourceName] : mirrorSources) {
+    auto it = loadedAnimations.find(animationName);
+    if (it == loadedAnimations.end()) continue;
+    for (const auto& frame : it->second.frames) {
+      if (frame.imageIndex < 0) continue;
+      const AtlasRegion& source = sourceRegions[frame.imageIndex];
+      size_t pixels = static_cast<size_t>(source.width) * source.height;
+      for (int p = 0; p < SUBPIXEL_PHASES; p++) {
+        const AtlasRegion& cached = frameRegions[frame.imageIndex * SUBPIXEL_PHASES + p];
+        pixels += static_cast<size_t>(cached.width) * cached.height;
+      }
+      savedPerImage[frame.imageIndex] = pixels * sizeof(uint32_t);
+    }
   }
+
+  size_t saved = 0;
+  for (const auto& [index, bytes] : savedPerImage) saved += bytes;
+  return saved;
 }
 
-void Sprite::CheckTransition() {
-  const auto& currentState = stateMachine[currentAnimation];
+int Sprite::LoadFrameImage(const std::string& imagePath)
+{
+  auto it = imageIndices.find(imagePath);
+  if (it != imageIndices.end()) return it->second;
+
+  // Decode into a scratch image, then keep the pixels in the atlas only
+  Image image;
+  if (!LoadImageFile(imagePath, image)) {
+    std::cerr << "Failed to load image: " << imagePath << std::endl;
+  }
 
-  // Group transitions by condition
-  std::unordered_map<std::string, std::vector<Transition>> conditionGroups;
+  int index = static_cast<int>(sourceRegions.size());
+  sourceRegions.push_back(sourceAtlas.Add(image.View()));
+  frameRegions.resize(frameRegions.size() + SUBPIXEL_PHASES);
+  frameSpans.resize(frameRegions.size());
+  frameMasks.resize(frameRegions.size());
+  imageIndices[imagePath] = index;
+
+  // Images loaded after SetHeight go straight into the cache
+  if (cacheHeight > 0) BakeImage(index);
+  return index;
+}
 
-  for (const auto& transition : currentState.transitions) {
-      conditionGroups[transition.condition].push_back(transition);
+void Sprite::EnterState(int region, int stateIndex) {
+  // A state without an animation keeps the one playing, one whose animation didn't load isn't entered
+  const Animation* animation = stateAnimations[stateIndex];
+  if (!animation && machine.states[stateIndex].animation >= 0) return;
+
+  LeaveState(region);
+  activeStates[region] = stateIndex;
+  activeRegions[region].entered = currentTime;
+  if (animation) {
+    playing = animation;
+    currentFrame = 0;
+    animationStart = currentTime;  // Track animation start time
+    movementX = playing->vx;
+    movementY = playing->vy;
+    animationEnded = false;
   }
+  pendingEvents = EVENT_ALL; // Nothing is known about the new state's conditions yet
+  ArmTimedTransitions(region);
+}
 
-  for (const auto& [condition, transitions] : conditionGroups) {
-    for (const auto& transition : transitions) {
-        if (EvaluateCondition(condition, transition)) {  // Pass the full transition object
-            float totalWeight = 0.0f;
-            for (const auto& t : transitions) {
-                totalWeight += t.probability;
-            }
+void Sprite::LeaveState(int region) {
+  for (auto handle : activeRegions[region].armedTimers) {
+    timers.Cancel(handle);
+  }
+  activeRegions[region].armedTimers.clear();
 
-            float r = static_cast<float>(rand()) / RAND_MAX * totalWeight;
+  if (activeStates[region] < 0) return;
+  const State& state = machine.states[activeStates[region]];
+  for (int i = state.firstTransition; i < state.firstTransition + state.transitionCount; i++) {
+    if (timerExpired[i]) expiredCount--;
+    timerExpired[i] = false;
+  }
+}
 
-            float cumulative = 0.0f;
-            for (const auto& t : transitions) {
-                cumulative += t.probability;
-                if (r <= cumulative) {
-                    ApplyTransition(stateMachine[t.to].animation);
-                    return;
-                }
-            }
-        }
+void Sprite::ArmTimedTransitions(int region) {
+  std::vector<TimerWheel::Handle>& armedTimers = activeRegions[region].armedTimers;
+  const State& state = machine.states[activeStates[region]];
+  for (int i = state.firstTransition; i < state.firstTransition + state.transitionCount; i++) {
+    const Transition& transition = machine.transitions[i];
+    if (transition.condition == Condition::SetInterval) {
+      armedTimers.push_back(timers.Schedule(currentTime + transition.intervalSet, i));
+    } else if (transition.condition == Condition::RandomInterval && transition.intervalMin > 0 && transition.intervalMax > 0) {
+      // A new random delay every time the state is entered
+      int range = transition.intervalMax - transition.intervalMin;
+      int randomInterval = transition.intervalMin + (range > 0 ? static_cast<int>(random() % static_cast<uint32_t>(range)) : 0);
+      armedTimers.push_back(timers.Schedule(currentTime + randomInterval, i));
     }
   }
 }
 
-bool Sprite::EvaluateCondition(const std::string& condition, const Transition& transition) {
-  DWORD now = GetTickCount();
-  
-  if (condition == "atEndOfScreen" && x + width >= screenWidth) return true;
-  if (condition == "atStartOfScreen" && x <= 0) return true;
-  if (condition == "randomInterval") {
-    DWORD startTime = animationStartTimes[currentAnimation];
-    DWORD elapsed = now - startTime;
-    
-    if (transition.intervalMin > 0 && transition.intervalMax > 0) {
-      static std::unordered_map<std::string, DWORD> randomDelays;
-      
-      // Generate a random delay once per animation
-      if (randomDelays.find(currentAnimation) == randomDelays.end()) {
-          int randomInterval = transition.intervalMin + (rand() % (transition.intervalMax - transition.intervalMin));
-          randomDelays[currentAnimation] = randomInterval;
+void Sprite::CheckTransition() {
+  uint8_t raised = pendingEvents;
+  pendingEvents = 0;
+
+  for (int r = 0; r < static_cast<int>(activeStates.size()); r++) {
+    int current = activeStates[r];
+    if (current < 0) continue;
+    const State& state = machine.states[current];
+
+    // Only conditions whose inputs changed since the last check can have a different outcome
+    uint8_t events = raised & state.events;
+    if (!events) continue;
+
+    for (int g = state.firstGroup; g < state.firstGroup + state.groupCount; g++) {
+      const ConditionGroup& group = machine.groups[g];
+      if (!(group.events & events) || !EvaluateCondition(group, r)) continue;
+
+      uint32_t columnBits = random(), coinBits = random();
+      int pick = group.first + SampleAliasTable(&machine.aliases[group.first], group.count, columnBits, coinBits);
+      if (machine.transitions[pick].to != current) {
+        EnterState(r, machine.transitions[pick].to);
+      } else {
+        // Staying in the current state doesn't restart it. The condition still holds and the groups
+        // after it weren't looked at, so check them all again next step.
+        pendingEvents |= events;
       }
-
-      return elapsed >= randomDelays[currentAnimation];
+      break;
     }
   }
-  if (condition == "setInterval") {
-    DWORD startTime = animationStartTimes[currentAnimation];
-    DWORD elapsed = now - startTime;
+}
 
-    return elapsed >= transition.intervalSet;
+bool Sprite::EvaluateCondition(const ConditionGroup& group, int region) {
+  switch (group.condition) {
+  case Condition::AtEndOfScreen:
+    return TestCondition<Condition::AtEndOfScreen>(group);
+  case Condition::AtStartOfScreen:
+    return TestCondition<Condition::AtStartOfScreen>(group);
+  case Condition::RandomInterval:
+    return TestCondition<Condition::RandomInterval>(group);
+  case Condition::SetInterval:
+    return TestCondition<Condition::SetInterval>(group);
+  case Condition::OnClick:
+    return TestCondition<Condition::OnClick>(group);
+  case Condition::AnimationEnd:
+    return TestCondition<Condition::AnimationEnd>(group);
+  case Condition::Expression:
+    return EvaluateExpression(machine.expressionCode.data(), machine.expressionConstants.data(), machine.expressions[group.expression], region);
+  case Condition::Plugin:
+    return EvaluatePlugin(group.plugin, region);
   }
-  if (condition == "onClick") {
-    bool wasClicked = clicked; 
-    clicked = false; 
+  return false;
+}
 
-    return wasClicked;
-  }
-  // Add more conditions here if needed
+bool Sprite::EvaluatePlugin(int plugin, int region) {
+  const ConditionRegistry::Entry* entry = pluginConditions[plugin];
+  if (!entry) return false;
+  ConditionInputs inputs;
+  inputs.x = posX;
+  inputs.y = posY;
+  inputs.width = static_cast<float>(width);
+  inputs.height = static_cast<float>(height);
+  inputs.left = static_cast<float>(worldLeft);
+  inputs.top = static_cast<float>(worldTop);
+  inputs.screenW = static_cast<float>(screenWidth);
+  inputs.screenH = static_cast<float>(screenHeight);
+  inputs.vx = movementX;
+  inputs.vy = movementY;
+  inputs.elapsed = static_cast<float>(currentTime - activeRegions[region].entered);
+  inputs.animationEnded = animationEnded ? 1 : 0;
+  return entry->function(&inputs, entry->userData) != 0;
+}
 
-  return false; // Default to false if the condition is unknown
+bool Sprite::EvaluateExpression(const ExpressionInstruction* code, const float* constants, const ExpressionProgram& program, int region) {
+  ExpressionContext context;
+  float* variables = context.variables;
+  variables[static_cast<int>(ExpressionVariable::X)] = posX;
+  variables[static_cast<int>(ExpressionVariable::Y)] = posY;
+  variables[static_cast<int>(ExpressionVariable::Width)] = static_cast<float>(width);
+  variables[static_cast<int>(ExpressionVariable::Height)] = static_cast<float>(height);
+  variables[static_cast<int>(ExpressionVariable::Left)] = static_cast<float>(worldLeft);
+  variables[static_cast<int>(ExpressionVariable::Top)] = static_cast<float>(worldTop);
+  variables[static_cast<int>(ExpressionVariable::ScreenW)] = static_cast<float>(screenWidth);
+  variables[static_cast<int>(ExpressionVariable::ScreenH)] = static_cast<float>(screenHeight);
+  variables[static_cast<int>(ExpressionVariable::VX)] = movementX;
+  variables[static_cast<int>(ExpressionVariable::VY)] = movementY;
+  variables[static_cast<int>(ExpressionVariable::Elapsed)] = static_cast<float>(currentTime - activeRegions[region].entered);
+  variables[static_cast<int>(ExpressionVariable::AnimationEnd)] = animationEnded ? 1.0f : 0.0f;
+  context.random = &random;
+  context.clicked = &clicked;
+  context.activeStates = activeStates.data();
+  context.activeStateCount = static_cast<int>(activeStates.size());
+  return RunExpression(code, constants, program, context);
 }
 
 void Sprite::OnMouseClick(int mouseX, int mouseY) {
   // Check if the click is inside the sprite's rectangle
   if (IsMouseOver(mouseX, mouseY)) {
       clicked = true;
+      pendingEvents |= EVENT_INPUT;
   }
 }
-bool Sprite::IsMouseOver(int mouseX, int mouseY) {
-  return mouseX >= x && mouseX <= (x + width) &&
-         mouseY >= y && mouseY <= (y + height);
+bool Sprite::IsMouseOver(int mouseX, int mouseY) const {
+  // Cheap reject on the bounding box first
+  int index = GetCurrentCacheIndex();
+  if (index < 0) return false;
+  const HitMask &mask = frameMasks[index];
+  int col = mouseX - x;
+  int row = mouseY - y;
+  if (col < 0 || row < 0 || col >= mask.width || row >= mask.height) return false;
+
+  // Then the pixel itself, the mask is of the unflipped image
+  if (GetCurrentFrame()->mirrored) col = mask.width - 1 - col;
+  return mask.Test(col, row);
 }
 
-void Sprite::ApplyTransition(const std::string& targetAnimation) {
-  if (currentAnimation != targetAnimation &&
-      loadedAnimations.find(targetAnimation) != loadedAnimations.end()) 
-  {
-    ApplyAnimation(targetAnimation);
-  } 
+size_t Sprite::GetHitMaskBytes() const {
+  size_t bytes = 0;
+  for (const auto &mask : frameMasks) bytes += mask.Bytes();
+  return bytes;
 }
 
-void Sprite::Update()
+bool Sprite::Update()
 {
-  if (currentFrames.empty()) return;
+  uint32_t now = clock.NowMs();
+  if (!playing || playing->frames.empty()) {
+    lastStepTime = currentTime = now;
+    return false;
+  }
 
-  DWORD now = GetTickCount();
-  int delta = now - lastUpdateTime;
-  elapsedSinceLastFrame += delta;
-  lastUpdateTime = now;
+  // What's on screen now, to tell whether this tick changed anything visible
+  int oldX = x, oldY = y, oldPhase = phase;
+  const Frame *oldFrame = GetCurrentFrame();
+  int oldImage = oldFrame->imageIndex;
+  bool oldMirrored = oldFrame->mirrored;
 
-  if (elapsedSinceLastFrame >= currentFrames[currentFrame].durationMs)
-  {
-    elapsedSinceLastFrame = 0;
-    currentFrame = (currentFrame + 1) % currentFrames.size();
+  // Way behind: drop whole steps so the ones left stay on the same step grid
+  int32_t behind = static_cast<int32_t>(now - lastStepTime);
+  if (behind > MAX_CATCH_UP_MS) {
+    lastStepTime += (behind - MAX_CATCH_UP_MS) / SIM_STEP_MS * SIM_STEP_MS;
+  }
+
+  while (static_cast<int32_t>(now - lastStepTime) >= SIM_STEP_MS) {
+    lastStepTime += SIM_STEP_MS;
+    Step();
   }
 
-  Move(movementX, movementY);
+  // Draw part way between the last two steps, by how far we are into the next one
+  float blend = std::clamp(static_cast<int32_t>(now - lastStepTime) / static_cast<float>(SIM_STEP_MS), 0.0f, 1.0f);
+  UpdateDrawPosition(prevPosX + (posX - prevPosX) * blend, prevPosY + (posY - prevPosY) * blend);
+
+  const Frame *newFrame = GetCurrentFrame();
+  if (!newFrame) return true;
+  return x != oldX || y != oldY || phase != oldPhase ||
+         newFrame->imageIndex != oldImage || newFrame->mirrored != oldMirrored;
+}
+
+void Sprite::Step()
+{
+  currentTime = lastStepTime;
+  prevPosX = posX;
+  prevPosY = posY;
+
+  // Timed transitions due by now
+  expiredScratch.clear();
+  timers.Advance(currentTime, expiredScratch);
+  for (uint32_t transitionIndex : expiredScratch) {
+    if (transitionIndex < timerExpired.size() && !timerExpired[transitionIndex]) {
+      timerExpired[transitionIndex] = true;
+      expiredCount++;
+    }
+  }
+  if (!expiredScratch.empty()) pendingEvents |= EVENT_TIME;
+  pendingEvents |= EVENT_STEP;
+
+  // Straight from the time since the animation started, so late steps never lose time
+  uint32_t elapsed = currentTime - animationStart;
+  currentFrame = playing->FrameAt(elapsed);
+  if (!animationEnded && elapsed >= playing->frameEnds.back()) {
+    animationEnded = true;
+    pendingEvents |= EVENT_ANIMATION_END;
+  }
+
+  Move(movementX * SIM_STEP_MS / 1000.0f, movementY * SIM_STEP_MS / 1000.0f);
 
   // Check for animation transitions
-  CheckTransition();
+  (this->*checkTransition)();
+}
+
+void Sprite::CheckTransitionNow(uint8_t events)
+{
+  pendingEvents |= events;
+  (this->*checkTransition)();
+}
+
+uint32_t Sprite::NextStepAt(uint32_t time) const
+{
+  int32_t ahead = static_cast<int32_t>(time - lastStepTime);
+  int32_t steps = std::max((ahead + SIM_STEP_MS - 1) / SIM_STEP_MS, 1);
+  return lastStepTime + steps * SIM_STEP_MS;
 }
 
-Gdiplus::Image *Sprite::GetCurrentFrameImage() const
+Deadline Sprite::GetNextDeadline() const
 {
-  if (currentFrames.empty() || currentFrame >= currentFrames.size()) return nullptr;
-  return currentFrames[currentFrame].image;
+  Deadline deadline;
+  const Frame *frame = GetCurrentFrame();
+  if (!frame) return deadline;
+
+  // Everything below only happens on a simulation step, so each time is rounded up to the step it falls on
+
+  // Next frame change
+  uint32_t changeAt;
+  if (playing->NextFrameChange(lastStepTime - animationStart, changeAt)) {
+    deadline.Add(NextStepAt(animationStart + changeAt));
+  }
+
+  // What the active states wait on
+  uint8_t events = 0;
+  for (int32_t state : activeStates) {
+    if (state >= 0) events |= machine.states[state].events;
+  }
+
+  // Moving changes the position (and atEndOfScreen/atStartOfScreen) every tick, and expressions reading
+  // the time or rolling dice have to be asked every tick too
+  deadline.continuous = movementX != 0 || movementY != 0 || (events & EVENT_STEP);
+
+  // A click is waiting for the next tick to be handled
+  if (clicked) deadline.Add(NextStepAt(lastStepTime));
+
+  // The animation playing through, if the state waits for that
+  if (!animationEnded && (events & EVENT_ANIMATION_END)) {
+    deadline.Add(NextStepAt(animationStart + playing->frameEnds.back()));
+  }
+
+  // Timed transitions out of the active states
+  uint32_t expiry;
+  if (timers.GetNextExpiry(expiry)) deadline.Add(NextStepAt(expiry));
+  // One that expired but whose pick stayed in its state is still true, and re-rolled every step
+  if (expiredCount > 0) {
+    deadline.Add(NextStepAt(lastStepTime));
+  }
+  return deadline;
 }
 
-void Sprite::Move(int dx, int dy)
+const Sprite::Frame *Sprite::GetCurrentFrame() const
 {
-  x += dx;
-  y += dy;
+  if (!playing || currentFrame >= static_cast<int>(playing->frames.size())) return nullptr;
+  return &playing->frames[currentFrame];
+}
+
+int Sprite::GetCurrentCacheIndex() const
+{
+  const Frame *frame = GetCurrentFrame();
+  if (!frame) return -1;
+  int index = frame->imageIndex;
+  if (index < 0 || index * SUBPIXEL_PHASES >= static_cast<int>(frameRegions.size())) return -1;
+
+  // Flipping phase p's block puts the content at 1 - p/PHASES within it, i.e. the opposite phase
+  int drawnPhase = frame->mirrored ? (SUBPIXEL_PHASES - phase) % SUBPIXEL_PHASES : phase;
+  return index * SUBPIXEL_PHASES + drawnPhase;
+}
+
+void Sprite::Move(float dx, float dy)
+{
+  float oldX = posX, oldY = posY;
+  posX += dx;
+  posY += dy;
   // if (x > screenWidth) x = -width;
   // Prevent the sprite from moving off the screen
-  if (x < 0) x = 0;
-  if (x + width > screenWidth) x = screenWidth - width;
+  if (posX < worldLeft) posX = static_cast<float>(worldLeft);
+  if (posX + width > worldLeft + screenWidth) posX = static_cast<float>(worldLeft + screenWidth - width);
+  if (posX != oldX || posY != oldY) pendingEvents |= EVENT_POSITION;
+}
+
+void Sprite::SetPosition(float px, float py)
+{
+  posX = prevPosX = px;
+  posY = prevPosY = py;
+  pendingEvents |= EVENT_POSITION;
+  UpdateDrawPosition(posX, posY);
 }
 
-void Sprite::SetPosition(int px, int py)
+void Sprite::UpdateDrawPosition(float drawX, float drawY)
 {
-  x = px;
-  y = py;
+  // Snap to the nearest phase, then split into whole pixels + phase
+  long subpixels = std::lround(drawX * SUBPIXEL_PHASES);
+  long whole = subpixels >= 0 ? subpixels / SUBPIXEL_PHASES : -((-subpixels + SUBPIXEL_PHASES - 1) / SUBPIXEL_PHASES);
+  x = static_cast<int>(whole);
+  phase = static_cast<int>(subpixels - whole * SUBPIXEL_PHASES);
+  y = static_cast<int>(std::lround(drawY));
+}
+
+void Sprite::SetWorldBounds(int left, int top, int w, int h)
+{
+  worldLeft = left;
+  worldTop = top;
+  screenWidth = w;
+  screenHeight = h;
+  pendingEvents |= EVENT_POSITION;
 }
 
 void Sprite::SetHeight(int h)
 {
   height = h;
-  if (!currentFrames.empty())
+  if (playing && !playing->frames.empty())
   {
     // Calculate aspect ratio from the first frame
-    Gdiplus::Image *firstImage = currentFrames[0].image;
-    if (firstImage != nullptr)
+    int firstIndex = playing->frames[0].imageIndex;
+    if (firstIndex >= 0 && sourceRegions[firstIndex].page >= 0)
     {
+      const AtlasRegion &firstImage = sourceRegions[firstIndex];
       // Aspect ratio = width / height of the first frame
-      float aspectRatio = static_cast<float>(firstImage->GetWidth()) / firstImage->GetHeight();
+      float aspectRatio = static_cast<float>(firstImage.width) / firstImage.height;
 
       // Set width based on height and maintain aspect ratio
       width = static_cast<int>(height * aspectRatio);
     }
   }
+
+  // Only re-bake when the display size actually changed
+  pendingEvents |= EVENT_POSITION; // The edges moved
+  if (width != cacheWidth || height != cacheHeight) BuildFrameCache();
 }
 
-void Sprite::Draw(Graphics &g)
+void Sprite::BuildFrameCache()
 {
-  Image *img = GetCurrentFrameImage();
-  if (!img) return;
-  g.DrawImage(img, x, y, width, height);
+  cacheWidth = width;
+  cacheHeight = height;
+
+  // Every baked frame is (about) the same size, so lay them out as a roughly square grid
+  size_t cachedCount = sourceRegions.size() * SUBPIXEL_PHASES;
+  int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(cachedCount))));
+  frameAtlas = Atlas(std::max(columns, 1) * (cacheWidth + 1));
+  for (int i = 0; i < static_cast<int>(sourceRegions.size()); i++)
+  {
+    BakeImage(i);
+  }
+}
+
+void Sprite::BakeImage(int imageIndex)
+{
+  AtlasRegion *regions = &frameRegions[imageIndex * SUBPIXEL_PHASES];
+  ImageView source = sourceAtlas.GetView(sourceRegions[imageIndex]);
+  if (source.Empty())
+  {
+    for (int p = 0; p < SUBPIXEL_PHASES; p++)
+    {
+      regions[p] = AtlasRegion();
+      frameSpans[imageIndex * SUBPIXEL_PHASES + p] = AlphaSpans();
+      frameMasks[imageIndex * SUBPIXEL_PHASES + p] = HitMask();
+    }
+    return;
+  }
+
+  // Resample once, drawing is then an unscaled copy
+  AtlasRegion region = frameAtlas.Allocate(cacheWidth, cacheHeight);
+  ScaleImage(source, frameAtlas.GetPixels(region), frameAtlas.GetView(region).stride, cacheWidth, cacheHeight);
+  regions[0] = region;
+
+  // Then shift that copy by each sub-pixel phase, so smooth motion is a lookup too
+  for (int p = 1; p < SUBPIXEL_PHASES; p++)
+  {
+    AtlasRegion shifted = frameAtlas.Allocate(cacheWidth + 1, cacheHeight);
+    ShiftImage(frameAtlas.GetView(regions[0]), frameAtlas.GetPixels(shifted), frameAtlas.GetView(shifted).stride,
+               p * 256 / SUBPIXEL_PHASES);
+    regions[p] = shifted;
+  }
+
+  // Find the transparent/opaque runs once, so draws skip or copy them instead of blending,
+  // and which pixels can be clicked
+  for (int p = 0; p < SUBPIXEL_PHASES; p++)
+  {
+    ImageView baked = frameAtlas.GetView(regions[p]);
+    EncodeAlphaSpans(baked.pixels, baked.width, baked.height, baked.stride, frameSpans[imageIndex * SUBPIXEL_PHASES + p]);
+    BuildHitMask(baked, frameMasks[imageIndex * SUBPIXEL_PHASES + p]);
+  }
+}
+
+void Sprite::Draw(Renderer &renderer)
+{
+  int index = GetCurrentCacheIndex();
+  if (index < 0) return;
+  ImageView frame = frameAtlas.GetView(frameRegions[index]);
+  if (frame.Empty()) return;
+  renderer.DrawImageSpans(frame, frameSpans[index], x, y, GetCurrentFrame()->mirrored);
+}
+
+void Sprite::DrawResampled(Renderer &renderer)
+{
+  const Frame *frame = GetCurrentFrame();
+  if (!frame || frame->imageIndex < 0) return;
+  ImageView source = sourceAtlas.GetView(sourceRegions[frame->imageIndex]);
+  if (source.Empty()) return;
+
+  // The same two filter passes BakeImage does, every draw
+  int drawnPhase = frame->mirrored ? (SUBPIXEL_PHASES - phase) % SUBPIXEL_PHASES : phase;
+  int drawnWidth = drawnPhase ? width + 1 : width;
+  resampleScratch.width = drawnWidth;
+  resampleScratch.height = height;
+  resampleScratch.pixels.resize(static_cast<size_t>(width) * height + static_cast<size_t>(drawnWidth) * height);
+  uint32_t *scaled = resampleScratch.pixels.data() + static_cast<size_t>(drawnWidth) * height;
+  ScaleImage(source, scaled, width, width, height);
+  if (drawnPhase) {
+    ShiftImage({ scaled, width, height, width }, resampleScratch.pixels.data(), drawnWidth, drawnPhase * 256 / SUBPIXEL_PHASES);
+  } else {
+    std::copy(scaled, scaled + static_cast<size_t>(width) * height, resampleScratch.pixels.begin());
+  }
+  renderer.DrawImage(resampleScratch.View(), x, y, frame->mirrored);
 }
@@ -1,79 +1,198 @@
 #pragma once
-#include <windows.h>
-#include <gdiplus.h>
 #include <vector>
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include "image.h"
+#include "atlas.h"
+#include "renderer.h"
+#include "scheduler.h"
+#include "timerWheel.h"
+#include "stateMachine.h"
+#include "conditionRegistry.h"
 
 class Sprite
 {
 public:
-    Sprite(int screenW, int screenH);
-    ~Sprite();
+    // clock is what Update reads the time from, it must outlive the sprite
+    Sprite(int screenW, int screenH, const Clock &clock = SystemClock());
 
     //void LoadFromJson(const std::wstring &jsonPath);
-    void LoadStateMachine(const std::wstring &stateMachinePath);
+    // stateMachine.json, or the precompiled form of it smc writes. Call after LoadAnimations, and after
+    // registering any conditions it uses with ConditionRegistry::Global().
+    bool LoadStateMachine(const std::string &stateMachinePath);
     void LoadAnimations(const std::string& folder);
 
-    void Update(); // Called every tick (e.g. 16ms)
-    void Move(int dx, int dy);
-    void Draw(Gdiplus::Graphics &g);
+    // An animations/*.json file compiled in by smc --header; its frames are a range of FrameSources
+    struct FrameSource
+    {
+        const char *image;
+        int durationMs;
+    };
+    struct AnimationSource
+    {
+        const char *name;
+        const char *mirrorOf; // Null unless it's a mirror
+        bool loop;
+        float vx, vy;
+        int firstFrame, frameCount;
+    };
+    // Instead of LoadAnimations and LoadStateMachine: the state machine and animations smc --header
+    // generated Tables from, so no JSON is read and transitions are checked by code specialised to
+    // these tables (see compiledTables.h). Only the images are still loaded from disk.
+    template <typename Tables> bool LoadStateTables();
+
+    // Runs however many fixed simulation steps are due and interpolates the drawn position between
+    // the last two. Call it as often as convenient; returns true if the sprite needs redrawing.
+    bool Update();
+    // Earliest tick count at which Update could change something
+    Deadline GetNextDeadline() const;
+    void Move(float dx, float dy);
+    void Draw(Renderer &renderer);
+    void DrawResampled(Renderer &renderer); // Resamples the frame on every call instead of using the phase cache (reference/benchmark)
     void OnMouseClick(int mouseX, int mouseY);
-    bool IsMouseOver(int mouseX, int mouseY);
+    // Checks the active states' transitions like a step does after raising events (EVENT_*), without moving or
+    // advancing time (benchmark)
+    void CheckTransitionNow(uint8_t events);
+    bool IsMouseOver(int mouseX, int mouseY) const; // Only over visible pixels of the current frame
 
-    void SetPosition(int x, int y);
+    void SetPosition(float x, float y);
     void SetHeight(int h);
+    // The area the sprite walks in, e.g. the whole virtual desktop (which may start at negative coordinates)
+    void SetWorldBounds(int left, int top, int w, int h);
 
+    int GetX() const { return x; } // Whole pixel part of the position
+    int GetY() const { return y; }
+    int GetPhase() const { return phase; } // Sub-pixel part of X, in 1/SUBPIXEL_PHASES pixels
     int GetHeight() const { return height; }
     int GetWidth() const { return width; }
     int GetScreenHeight() const { return screenHeight; }
     int GetScreenWidth() const { return screenWidth; }
+    int GetWorldLeft() const { return worldLeft; }
+    int GetWorldTop() const { return worldTop; }
+    size_t GetFrameCacheBytes() const { return frameAtlas.GetBytes(); } // Memory used by the display-size frame cache
+    const Atlas &GetSourceAtlas() const { return sourceAtlas; }
+    const Atlas &GetFrameAtlas() const { return frameAtlas; }
+    const std::vector<AlphaSpans> &GetFrameSpans() const { return frameSpans; }
+    size_t GetHitMaskBytes() const;
+    size_t GetMirrorSavedBytes() const; // Memory "mirrorOf" animations would have cost with their own images
+
+    // Horizontal sub-pixel positions every frame is pre-baked at
+    static const int SUBPIXEL_PHASES = 4;
+    // Length of one simulation step, independent of how often Update is called
+    static const int SIM_STEP_MS = 16;
+    // Falling further behind than this (e.g. after a suspend) skips the excess instead of catching up
+    static const int MAX_CATCH_UP_MS = 250;
 
 private:
     struct Frame
     {
-        Gdiplus::Image *image;
+        int imageIndex = -1; // Slot in sourceRegions and frameRegions
         int durationMs;
+        bool mirrored = false; // Drawn flipped horizontally
     };
-    struct Transition {
-        std::string to;
-        std::string condition;
-        float probability = 1.0f;
-        int intervalMin = 0;  // Minimum wait time for "randomInterval"
-        int intervalMax = 0;  // Maximum wait time for "randomInterval"
-        int intervalSet = 0;  // Exact wait time for "setInterval"
-    };
-    struct State {
-        std::string animation;
-        std::vector<Transition> transitions;
+    // Frames plus their running end times, so the frame at any time since the start is a binary search
+    struct Animation
+    {
+        std::vector<Frame> frames;
+        std::vector<uint32_t> frameEnds; // frameEnds[i] = sum of durations of frames 0..i
+        bool loop = true;                // Otherwise it stays on the last frame
+        float vx = 0, vy = 0;            // Velocity in pixels per second
+
+        void BuildTimeline();
+        int FrameAt(uint32_t elapsed) const;
+        // Time since the start at which the frame shown at elapsed is replaced, false if it never is
+        bool NextFrameChange(uint32_t elapsed, uint32_t &changeAt) const;
     };
+    using Transition = StateMachine::Transition;
+    using ConditionGroup = StateMachine::ConditionGroup;
+    using State = StateMachine::State;
 
-    std::map<std::string, std::vector<Frame>> loadedAnimations; // Store animations
-    std::map<std::string, std::pair<int, int>> animationMovements; // dx, dy
-    std::map<std::string, State> stateMachine;  // State machine with transitions
-    std::unordered_map<std::string, DWORD> animationStartTimes;
+    std::map<std::string, Animation> loadedAnimations; // Store animations
+    std::map<std::string, std::string> mirrorSources; // Animation -> the animation it mirrors
+    StateMachine machine;
+    std::vector<const Animation *> stateAnimations; // Per state of machine, null if it has none or it isn't loaded
+    std::vector<const ConditionRegistry::Entry *> pluginConditions; // Per plugin condition of machine, null if not registered
+    std::vector<int32_t> activeStates; // Per region of machine, -1 until its initial state was entered
+    uint8_t pendingEvents = 0; // EVENT_* since the last CheckTransition
+    bool animationEnded = false; // The playing animation has played through once
+    std::mt19937 random; // Picks between the transitions of a group, and randomInterval delays
+    // Every distinct frame image, as decoded, packed into one atlas
+    Atlas sourceAtlas{256}; // Source frames are small, a narrow page wastes less
+    std::vector<AtlasRegion> sourceRegions;
+    std::map<std::string, int> imageIndices; // Image path -> index, so shared images load once
+    // The same images baked at display size and at every sub-pixel phase, so drawing is a straight copy.
+    // Phase p of image i is frameRegions[i * SUBPIXEL_PHASES + p]; phases above 0 are one pixel wider.
+    Atlas frameAtlas;
+    std::vector<AtlasRegion> frameRegions;
+    std::vector<AlphaSpans> frameSpans; // Transparent/opaque/partial runs of each frameRegions entry
+    std::vector<HitMask> frameMasks;    // Visible pixels of each frameRegions entry
+    Image resampleScratch; // Reused by DrawResampled
+    int cacheWidth = 0, cacheHeight = 0; // Size the cache was last built for
 
     int currentFrame = 0;
-    std::string currentAnimation;
-    std::vector<Frame> currentFrames;
+    const Animation *playing = nullptr; // Animation of the state last entered that has one
+    uint32_t animationStart = 0;        // Tick count it started at
 
+    int worldLeft = 0;
+    int worldTop = 0;
     int screenWidth;
     int screenHeight;
-    int x = 0, y = 0;
+    float posX = 0, posY = 0;         // Simulated position after the last step
+    float prevPosX = 0, prevPosY = 0; // And before it, drawing interpolates between the two
+    int x = 0, y = 0;                 // Where it's drawn: rounded to the nearest phase horizontally, pixel vertically
+    int phase = 0;
     int width = 100, height = 100;
-    int movementX = 0;
-    int movementY = 0;
-    bool clicked;
+    float movementX = 0; // Pixels per second
+    float movementY = 0;
+    bool clicked = false;
 
-    DWORD lastUpdateTime = 0;
-    int elapsedSinceLastFrame = 0;
+    const Clock &clock;
+    uint32_t currentTime;     // Tick count (Clock::NowMs) of the step being simulated
+    uint32_t lastStepTime;    // Tick count the last simulation step ran at
 
-    void LoadAnimation(const std::string& animationName, const std::wstring& animationPath);
-    void ApplyAnimation(const std::string& animationName);
+    // "setInterval"/"randomInterval" transitions are armed once when their state is entered,
+    // expiry marks them due instead of polling the elapsed time every step
+    TimerWheel timers;
+    struct ActiveRegion
+    {
+        uint32_t entered = 0; // Tick count its state was entered at, for "elapsed"
+        std::vector<TimerWheel::Handle> armedTimers;
+    };
+    std::vector<ActiveRegion> activeRegions; // Per region of machine
+    std::vector<bool> timerExpired;        // Per transition of machine, only ever set for active states'
+    int expiredCount = 0;                  // How many are set
+    std::vector<uint32_t> expiredScratch;  // Reused by Step
+
+    void LoadAnimation(const std::string& animationName, const std::string& animationPath);
+    void ResolveMirroredAnimations();
+    void LoadAnimation(const AnimationSource& source, const FrameSource* frames);
+    void StopStateMachine();
+    bool StartStateMachine(); // Once machine is loaded
+    void EnterState(int region, int stateIndex);
+    void LeaveState(int region);
+    void ArmTimedTransitions(int region);
     void CheckTransition();
-    void ApplyTransition(const std::string& targetAnimation);
-    bool EvaluateCondition(const std::string& condition, const Transition& transition);
-    
-    Gdiplus::Image *GetCurrentFrameImage() const;
+    bool EvaluateCondition(const ConditionGroup& group, int region);
+    bool EvaluateExpression(const ExpressionInstruction* code, const float* constants, const ExpressionProgram& program, int region);
+    bool EvaluatePlugin(int plugin, int region);
+    template <Condition C> bool TestCondition(const ConditionGroup& group); // Any but Expression and Plugin
+    // CheckTransition for LoadStateTables, unrolled over the states and groups of Tables
+    template <typename Tables> void CheckTransitionCompiled();
+    template <typename Tables, int... S> void CheckStateCompiled(int region, int current, uint8_t raised, std::integer_sequence<int, S...>);
+    template <typename Tables, int S, int... G> void CheckGroupsCompiled(int region, uint8_t raised, std::integer_sequence<int, G...>);
+    template <typename Tables, int G> bool CheckGroupCompiled(int region, int current, uint8_t events);
+    void (Sprite::*checkTransition)() = &Sprite::CheckTransition; // Or the CheckTransitionCompiled LoadStateTables picked
+    void BuildFrameCache();
+    int LoadFrameImage(const std::string& imagePath);
+    void BakeImage(int imageIndex);
+    void Step();
+    void UpdateDrawPosition(float drawX, float drawY);
+    uint32_t NextStepAt(uint32_t time) const; // Tick count of the first step at or after time
+
+    int GetCurrentCacheIndex() const; // Index into frameRegions/frameSpans of what's drawn now, -1 if nothing
+    const Frame *GetCurrentFrame() const;
 };
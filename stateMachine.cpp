@@ -0,0 +1,690 @@
+#include "stateMachine.h"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include "nlohmann/json.hpp"
+#include "conditionRegistry.h"
+
+namespace {
+
+const char *const CONDITION_NAMES[] = { "atEndOfScreen", "atStartOfScreen", "randomInterval", "setInterval", "onClick", "animationEnd", "when", "plugin" };
+const int CONDITION_COUNT = sizeof(CONDITION_NAMES) / sizeof(CONDITION_NAMES[0]);
+
+bool ParseCondition(const std::string &name, Condition &condition) {
+    // All but Expression, which comes from "when"
+    for (int i = 0; i < static_cast<int>(Condition::Expression); i++) {
+        if (name == CONDITION_NAMES[i]) {
+            condition = static_cast<Condition>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Layout of the precompiled file: this header, then the states, regions, groups, transitions, alias entries,
+// expressions, expression code and expression constants as they are in memory, then the state,
+// animation and plugin condition names, each NUL terminated
+const char MAGIC[4] = { 'D', 'G', 'S', 'M' };
+const uint32_t VERSION = 4;
+
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t stateCount, regionCount, groupCount, transitionCount, animationCount, pluginCount;
+    uint32_t expressionCount, instructionCount, constantCount;
+    uint32_t nameBytes;
+};
+
+// A state as written in the JSON, before the hierarchy is flattened
+struct SourceState
+{
+    std::string name;
+    const nlohmann::ordered_json *data = nullptr;
+    int parent = -1;                  // -1 for the root of a region
+    int region = 0;
+    std::vector<int> children;
+    int leaf = -1;                    // Index in StateMachine::states, if nothing is nested inside it
+    int firstLeaf = 0, leafCount = 0; // The innermost states inside it (itself for one of those)
+    int initial = -1;                 // The innermost state entered when it's a transition's target
+    std::vector<StateMachine::Transition> transitions; // Its own
+    std::vector<int> uses;            // How many innermost states each of those ended up in
+};
+
+// A transition's string field, or nullptr if it's missing or not a string
+const std::string *StringField(const nlohmann::ordered_json &object, const char *key) {
+    auto it = object.find(key);
+    return it != object.end() && it->is_string() ? it->get_ptr<const std::string *>() : nullptr;
+}
+
+// Reads an optional number field into value; false if it's there but isn't a number
+template <typename T>
+bool NumberField(const nlohmann::ordered_json &object, const char *key, T &value) {
+    auto it = object.find(key);
+    if (it == object.end()) return true;
+    if (!it->is_number()) return false;
+    value = it->get<T>();
+    return true;
+}
+
+bool SameCondition(const StateMachine::Transition &l, const StateMachine::Transition &r) {
+    return l.condition == r.condition && l.expression == r.expression && l.plugin == r.plugin;
+}
+
+template <typename T>
+void AppendRecords(std::vector<char> &out, const std::vector<T> &records) {
+    const char *bytes = reinterpret_cast<const char *>(records.data());
+    out.insert(out.end(), bytes, bytes + records.size() * sizeof(T));
+}
+
+template <typename T>
+bool ReadRecords(const std::vector<char> &in, size_t &offset, uint32_t count, std::vector<T> &records) {
+    size_t bytes = static_cast<size_t>(count) * sizeof(T);
+    if (in.size() - offset < bytes) return false;
+    records.resize(count);
+    std::memcpy(records.data(), in.data() + offset, bytes);
+    offset += bytes;
+    return true;
+}
+
+}
+
+void StateMachine::Clear() {
+    states.clear();
+    regions.clear();
+    groups.clear();
+    transitions.clear();
+    aliases.clear();
+    expressions.clear();
+    expressionCode.clear();
+    expressionConstants.clear();
+    stateNames.clear();
+    animationNames.clear();
+    pluginNames.clear();
+    warnings.clear();
+}
+
+bool StateMachine::Load(const std::string &path, const ConditionRegistry *conditions) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    bool precompiled = file.gcount() == sizeof(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    file.close();
+    return precompiled ? LoadBinary(path) : LoadJson(path, conditions);
+}
+
+bool StateMachine::LoadJson(const std::string &path, const ConditionRegistry *conditions) {
+    Clear();
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open state machine file" << std::endl;
+        return false;
+    }
+
+    nlohmann::ordered_json j;
+    try {
+        file >> j;
+    } catch (const std::exception &e) {
+        std::cerr << "Error loading state machine: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Build the tree of states. Innermost states are numbered depth first, so the ones inside any
+    // state (and any region) are contiguous.
+    bool ok = true;
+    std::vector<SourceState> sources;
+    std::map<std::string, int> sourceIndices;
+    std::function<void(int, const nlohmann::ordered_json &)> addChildren = [&](int parent, const nlohmann::ordered_json &children) {
+        for (auto &child : children.items()) {
+            if (sourceIndices.count(child.key())) {
+                std::cerr << "State " << child.key() << " is defined twice" << std::endl;
+                ok = false;
+                continue;
+            }
+            int index = static_cast<int>(sources.size());
+            sourceIndices[child.key()] = index;
+            SourceState source;
+            source.name = child.key();
+            source.data = &child.value();
+            source.parent = parent;
+            source.region = sources[parent].region;
+            source.firstLeaf = static_cast<int>(stateNames.size());
+            sources.push_back(source);
+            sources[parent].children.push_back(index);
+
+            auto substates = child.value().find("states");
+            if (substates != child.value().end() && !substates->empty()) {
+                addChildren(index, *substates);
+            } else {
+                sources[index].leaf = static_cast<int>(stateNames.size());
+                stateNames.push_back(child.key());
+            }
+            sources[index].leafCount = static_cast<int>(stateNames.size()) - sources[index].firstLeaf;
+        }
+    };
+    auto addRegion = [&](const std::string &name, const nlohmann::ordered_json *data, const nlohmann::ordered_json &children) {
+        SourceState root;
+        root.name = name;
+        root.data = data;
+        root.region = static_cast<int>(regions.size());
+        root.firstLeaf = static_cast<int>(stateNames.size());
+        int index = static_cast<int>(sources.size());
+        sources.push_back(root);
+        addChildren(index, children);
+        sources[index].leafCount = static_cast<int>(stateNames.size()) - sources[index].firstLeaf;
+
+        Region region;
+        region.firstState = sources[index].firstLeaf;
+        region.stateCount = sources[index].leafCount;
+        regions.push_back(region);
+    };
+
+    // Either {"state": {...}, ...} or, for orthogonal regions, {"regions": {"name": {"states": {...}}, ...}}
+    auto regionsIt = j.find("regions");
+    if (regionsIt != j.end()) {
+        for (auto &region : regionsIt->items()) {
+            auto statesIt = region.value().find("states");
+            if (statesIt == region.value().end() || statesIt->empty()) {
+                std::cerr << "Region " << region.key() << " has no states" << std::endl;
+                ok = false;
+                continue;
+            }
+            addRegion(region.key(), &region.value(), *statesIt);
+        }
+    } else {
+        addRegion("", nullptr, j);
+    }
+    if (stateNames.empty()) {
+        std::cerr << "No states in " << path << std::endl;
+        Clear();
+        return false;
+    }
+
+    // Entering a state means entering its "initial" state, by default the first one inside it, and so on down
+    std::function<int(int)> initialOf = [&](int index) {
+        const SourceState &source = sources[index];
+        if (source.leaf >= 0) return source.leaf;
+        if (source.children.empty()) return -1;
+        int child = source.children[0];
+        if (source.data && source.data->contains("initial")) {
+            const std::string *initial = StringField(*source.data, "initial");
+            auto namedIt = initial ? sourceIndices.find(*initial) : sourceIndices.end();
+            if (namedIt != sourceIndices.end() && sources[namedIt->second].firstLeaf >= source.firstLeaf &&
+                sources[namedIt->second].firstLeaf < source.firstLeaf + source.leafCount) {
+                child = namedIt->second;
+            } else if (initial) {
+                std::cerr << (source.parent < 0 ? "Region " : "State ") << source.name << ": initial state " << *initial << " isn't inside it" << std::endl;
+                ok = false;
+            } else {
+                std::cerr << (source.parent < 0 ? "Region " : "State ") << source.name << ": invalid \"initial\"" << std::endl;
+                ok = false;
+            }
+        }
+        return initialOf(child);
+    };
+    for (size_t i = 0; i < sources.size(); i++) {
+        sources[i].initial = initialOf(static_cast<int>(i));
+        if (sources[i].parent < 0 && sources[i].initial >= 0) regions[sources[i].region].initial = sources[i].initial;
+    }
+
+    // What in() can name
+    ExpressionStates stateRanges;
+    for (const auto &[name, index] : sourceIndices) stateRanges[name] = { sources[index].firstLeaf, sources[index].leafCount };
+
+    // Every state's own transitions, names resolved
+    std::map<std::string, int> expressionIndices;
+    std::map<std::string, int> pluginIndices;
+    std::vector<uint8_t> pluginEvents;
+    for (auto &source : sources) {
+        auto transitionsIt = source.data ? source.data->find("transitions") : nlohmann::ordered_json::const_iterator();
+        if (!source.data || transitionsIt == source.data->end()) continue;
+        const std::string &stateName = source.parent < 0 ? "Region " + source.name : "State " + source.name;
+        if (!transitionsIt->is_array()) {
+            std::cerr << stateName << ": \"transitions\" isn't a list" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        int number = 0;
+        for (const auto &transition : *transitionsIt) {
+            // Numbered from 1 as they appear, for messages about the ones that can't be read
+            number++;
+            auto invalid = [&](const char *key) {
+                std::cerr << stateName << ": transition " << number << ": missing or invalid \"" << key << "\"" << std::endl;
+                ok = false;
+            };
+            Transition newTransition;
+            const std::string *target = StringField(transition, "to");
+            if (!target) {
+                invalid("to");
+                continue;
+            }
+            const std::string &to = *target;
+            auto targetIt = sourceIndices.find(to);
+            if (targetIt == sourceIndices.end()) {
+                std::cerr << stateName << ": transition to unknown state " << to << std::endl;
+                ok = false;
+                continue;
+            }
+            if (sources[targetIt->second].region != source.region) {
+                std::cerr << stateName << ": transition to " << to << ", which is in another region" << std::endl;
+                ok = false;
+                continue;
+            }
+            newTransition.to = sources[targetIt->second].initial;
+
+            if (transition.contains("when")) {
+                // Compiled once however many transitions share it
+                const std::string *when = StringField(transition, "when");
+                if (!when) {
+                    invalid("when");
+                    continue;
+                }
+                const std::string &text = *when;
+                auto expressionIt = expressionIndices.find(text);
+                if (expressionIt == expressionIndices.end()) {
+                    ExpressionProgram program;
+                    std::string error;
+                    if (!CompileExpression(text, expressionCode, expressionConstants, program, error, &stateRanges)) {
+                        std::cerr << stateName << ": " << error << std::endl;
+                        ok = false;
+                        continue;
+                    }
+                    expressionIt = expressionIndices.emplace(text, static_cast<int>(expressions.size())).first;
+                    expressions.push_back(program);
+                }
+                newTransition.condition = Condition::Expression;
+                newTransition.expression = expressionIt->second;
+            } else {
+                const std::string *name = StringField(transition, "condition");
+                if (!name) {
+                    invalid("condition");
+                    continue;
+                }
+                const std::string &condition = *name;
+                if (!ParseCondition(condition, newTransition.condition)) {
+                    const ConditionRegistry::Entry *entry = conditions ? conditions->Find(condition) : nullptr;
+                    if (!entry) {
+                        std::cerr << stateName << ": unknown condition " << condition << std::endl;
+                        ok = false;
+                        continue;
+                    }
+                    auto pluginIt = pluginIndices.find(condition);
+                    if (pluginIt == pluginIndices.end()) {
+                        pluginIt = pluginIndices.emplace(condition, static_cast<int>(pluginNames.size())).first;
+                        pluginNames.push_back(condition);
+                        pluginEvents.push_back(entry->events);
+                    }
+                    newTransition.condition = Condition::Plugin;
+                    newTransition.plugin = pluginIt->second;
+                }
+            }
+
+            const char *badNumber = !NumberField(transition, "probability", newTransition.probability) ? "probability"
+                                    : !NumberField(transition, "intervalMin", newTransition.intervalMin) ? "intervalMin"
+                                    : !NumberField(transition, "intervalMax", newTransition.intervalMax) ? "intervalMax"
+                                    : !NumberField(transition, "intervalSet", newTransition.intervalSet) ? "intervalSet"
+                                                                                                         : nullptr;
+            if (badNumber) {
+                invalid(badNumber);
+                continue;
+            }
+            // randomInterval needs both ends
+            if (!transition.contains("intervalMin") || !transition.contains("intervalMax")) {
+                newTransition.intervalMin = newTransition.intervalMax = 0;
+            }
+            if (newTransition.to >= 0) source.transitions.push_back(newTransition);
+        }
+        source.uses.assign(source.transitions.size(), 0);
+    }
+
+    // Flatten: each innermost state gets its own transitions, then those of every state around it,
+    // nearest first, except for conditions a nearer one already has
+    states.assign(stateNames.size(), State());
+    std::map<std::string, int> animationIndices;
+    std::vector<Transition> stateTransitions;
+    for (size_t index = 0; index < sources.size(); index++) {
+        const SourceState &leaf = sources[index];
+        if (leaf.leaf < 0) continue;
+        State &newState = states[leaf.leaf];
+
+        const std::string *animation = StringField(*leaf.data, "animation");
+        if (!animation && leaf.data->contains("animation")) {
+            std::cerr << "State " << leaf.name << ": invalid \"animation\"" << std::endl;
+            ok = false;
+        }
+        if (animation) {
+            const std::string &animationName = *animation;
+            auto indexIt = animationIndices.find(animationName);
+            if (indexIt == animationIndices.end()) {
+                indexIt = animationIndices.emplace(animationName, static_cast<int>(animationNames.size())).first;
+                animationNames.push_back(animationName);
+            }
+            newState.animation = indexIt->second;
+        }
+
+        stateTransitions.clear();
+        for (int level = static_cast<int>(index); level >= 0; level = sources[level].parent) {
+            SourceState &source = sources[level];
+            size_t nearer = stateTransitions.size();
+            for (size_t t = 0; t < source.transitions.size(); t++) {
+                bool overridden = std::any_of(stateTransitions.begin(), stateTransitions.begin() + nearer,
+                                              [&](const Transition &other) { return SameCondition(other, source.transitions[t]); });
+                if (overridden) continue;
+                stateTransitions.push_back(source.transitions[t]);
+                source.uses[t]++;
+            }
+        }
+
+        // Store them grouped by condition (and expression), in the order each first appears
+        std::vector<Transition> grouped;
+        for (const auto &transition : stateTransitions) {
+            bool seen = std::any_of(grouped.begin(), grouped.end(), [&](const Transition &t) { return SameCondition(t, transition); });
+            if (seen) continue;
+            for (const auto &member : stateTransitions) {
+                if (SameCondition(member, transition)) grouped.push_back(member);
+            }
+        }
+
+        newState.firstTransition = static_cast<int32_t>(transitions.size());
+        newState.transitionCount = static_cast<int32_t>(grouped.size());
+        newState.firstGroup = static_cast<int32_t>(groups.size());
+        for (auto &transition : grouped) {
+            int32_t position = static_cast<int32_t>(transitions.size());
+            if (newState.groupCount == 0 || !SameCondition(transitions.back(), transition)) {
+                ConditionGroup group;
+                group.condition = transition.condition;
+                group.first = position;
+                group.expression = transition.expression;
+                group.plugin = transition.plugin;
+                group.events = transition.condition == Condition::Expression ? expressions[transition.expression].events
+                               : transition.condition == Condition::Plugin   ? pluginEvents[transition.plugin]
+                                                                             : ConditionEvents(transition.condition);
+                newState.events |= group.events;
+                groups.push_back(group);
+                newState.groupCount++;
+            }
+            groups.back().count++;
+            transitions.push_back(transition);
+        }
+    }
+
+    for (const auto &source : sources) {
+        for (size_t t = 0; t < source.transitions.size(); t++) {
+            if (source.uses[t] > 0) continue;
+            const Transition &transition = source.transitions[t];
+            warnings.push_back((source.parent < 0 ? "region " : "state ") + source.name + ": transition to " + stateNames[transition.to] +
+                               " (" + ConditionName(transition) + ") is overridden in every state inside it");
+        }
+    }
+
+    // Built once, so picking the target when a condition holds doesn't depend on how many there are
+    aliases.assign(transitions.size(), AliasEntry());
+    std::vector<float> weights;
+    for (const auto &group : groups) {
+        weights.clear();
+        for (int i = group.first; i < group.first + group.count; i++) {
+            weights.push_back(transitions[i].probability);
+        }
+        BuildAliasTable(weights.data(), group.count, &aliases[group.first]);
+    }
+    return ok;
+}
+
+bool StateMachine::SaveBinary(const std::string &path) const {
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.stateCount = static_cast<uint32_t>(states.size());
+    header.regionCount = static_cast<uint32_t>(regions.size());
+    header.groupCount = static_cast<uint32_t>(groups.size());
+    header.transitionCount = static_cast<uint32_t>(transitions.size());
+    header.animationCount = static_cast<uint32_t>(animationNames.size());
+    header.pluginCount = static_cast<uint32_t>(pluginNames.size());
+    header.expressionCount = static_cast<uint32_t>(expressions.size());
+    header.instructionCount = static_cast<uint32_t>(expressionCode.size());
+    header.constantCount = static_cast<uint32_t>(expressionConstants.size());
+
+    std::vector<char> names;
+    for (const auto &name : stateNames) names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+    for (const auto &name : animationNames) names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+    for (const auto &name : pluginNames) names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+    header.nameBytes = static_cast<uint32_t>(names.size());
+
+    std::vector<char> out(reinterpret_cast<const char *>(&header), reinterpret_cast<const char *>(&header) + sizeof(header));
+    AppendRecords(out, states);
+    AppendRecords(out, regions);
+    AppendRecords(out, groups);
+    AppendRecords(out, transitions);
+    AppendRecords(out, aliases);
+    AppendRecords(out, expressions);
+    AppendRecords(out, expressionCode);
+    AppendRecords(out, expressionConstants);
+    out.insert(out.end(), names.begin(), names.end());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    return static_cast<bool>(file);
+}
+
+bool StateMachine::LoadBinary(const std::string &path) {
+    Clear();
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open state machine file" << std::endl;
+        return false;
+    }
+
+    // All of it in one go, then copied out of the buffer
+    std::vector<char> in(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(in.data(), static_cast<std::streamsize>(in.size()));
+
+    Header header;
+    if (!file || in.size() < sizeof(header)) {
+        std::cerr << "Failed to read " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, in.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        std::cerr << path << " isn't a version " << VERSION << " precompiled state machine, rebuild it with smc" << std::endl;
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    bool ok = ReadRecords(in, offset, header.stateCount, states) &&
+              ReadRecords(in, offset, header.regionCount, regions) &&
+              ReadRecords(in, offset, header.groupCount, groups) &&
+              ReadRecords(in, offset, header.transitionCount, transitions) &&
+              ReadRecords(in, offset, header.transitionCount, aliases) &&
+              ReadRecords(in, offset, header.expressionCount, expressions) &&
+              ReadRecords(in, offset, header.instructionCount, expressionCode) &&
+              ReadRecords(in, offset, header.constantCount, expressionConstants) &&
+              in.size() - offset == header.nameBytes;
+
+    // Names are NUL terminated, the last one included
+    uint32_t nameCount = header.stateCount + header.animationCount;
+    for (uint32_t i = 0; ok && i < nameCount + header.pluginCount; i++) {
+        const char *name = in.data() + offset;
+        const void *end = std::memchr(name, 0, in.size() - offset);
+        if (!end) {
+            ok = false;
+            break;
+        }
+        (i < header.stateCount ? stateNames : i < nameCount ? animationNames : pluginNames).emplace_back(name);
+        offset = static_cast<const char *>(end) - in.data() + 1;
+    }
+
+    // Every index has to land inside the tables it points into
+    int32_t transitionCount = static_cast<int32_t>(transitions.size());
+    int32_t groupCount = static_cast<int32_t>(groups.size());
+    for (const auto &state : states) {
+        ok = ok && state.animation >= -1 && state.animation < static_cast<int32_t>(animationNames.size()) &&
+             state.firstTransition >= 0 && state.transitionCount >= 0 && state.firstTransition <= transitionCount - state.transitionCount &&
+             state.firstGroup >= 0 && state.groupCount >= 0 && state.firstGroup <= groupCount - state.groupCount;
+    }
+    // Regions cover the states one after the other
+    int32_t nextState = 0;
+    for (const auto &region : regions) {
+        ok = ok && region.firstState == nextState && region.stateCount > 0 &&
+             region.initial >= region.firstState && region.initial < region.firstState + region.stateCount;
+        nextState = region.firstState + region.stateCount;
+    }
+    ok = ok && !regions.empty() && nextState == static_cast<int32_t>(states.size());
+    for (const auto &group : groups) {
+        ok = ok && static_cast<int>(group.condition) < CONDITION_COUNT &&
+             group.first >= 0 && group.count > 0 && group.first <= transitionCount - group.count &&
+             (group.condition != Condition::Expression || (group.expression >= 0 && group.expression < static_cast<int32_t>(expressions.size()))) &&
+             (group.condition != Condition::Plugin || (group.plugin >= 0 && group.plugin < static_cast<int32_t>(pluginNames.size())));
+    }
+    for (const auto &program : expressions) {
+        ok = ok && CheckExpression(program, expressionCode, expressionConstants.size());
+    }
+    for (const auto &transition : transitions) {
+        ok = ok && transition.to >= 0 && transition.to < static_cast<int32_t>(states.size()) &&
+             static_cast<int>(transition.condition) < CONDITION_COUNT;
+    }
+    // Aliases are relative to their group
+    for (size_t g = 0; ok && g < groups.size(); g++) {
+        for (int32_t i = groups[g].first; i < groups[g].first + groups[g].count; i++) {
+            ok = ok && aliases[i].alias < static_cast<uint32_t>(groups[g].count);
+        }
+    }
+    // A state's groups cover only its own transitions, and those stay in the state's region
+    for (const auto &region : regions) {
+        for (int32_t s = region.firstState; ok && s < region.firstState + region.stateCount; s++) {
+            const State &state = states[s];
+            for (int32_t g = state.firstGroup; g < state.firstGroup + state.groupCount; g++) {
+                ok = ok && groups[g].first >= state.firstTransition &&
+                     groups[g].first + groups[g].count <= state.firstTransition + state.transitionCount;
+            }
+            for (int32_t t = state.firstTransition; t < state.firstTransition + state.transitionCount; t++) {
+                ok = ok && transitions[t].to >= region.firstState && transitions[t].to < region.firstState + region.stateCount;
+            }
+        }
+    }
+
+    if (!ok) {
+        std::cerr << path << " is corrupt, rebuild it with smc" << std::endl;
+        Clear();
+    }
+    return ok;
+}
+
+int StateMachine::Validate(const std::vector<std::string> &knownAnimations, std::ostream &out) const {
+    int errors = 0;
+    if (states.empty()) {
+        out << "error: no states" << std::endl;
+        return 1;
+    }
+
+    for (const auto &warning : warnings) out << "warning: " << warning << std::endl;
+
+    for (size_t s = 0; s < states.size(); s++) {
+        if (states[s].animation < 0) continue;
+        const std::string &animation = animationNames[states[s].animation];
+        if (std::find(knownAnimations.begin(), knownAnimations.end(), animation) == knownAnimations.end()) {
+            out << "error: state " << stateNames[s] << ": no animation named " << animation << std::endl;
+            errors++;
+        }
+    }
+
+    // Transitions that can never be taken, and ones that repeat another
+    std::vector<bool> live(transitions.size(), true);
+    for (size_t s = 0; s < states.size(); s++) {
+        const State &state = states[s];
+        if (state.transitionCount == 0) {
+            out << "warning: state " << stateNames[s] << " has no transitions, it's never left" << std::endl;
+        }
+        for (int g = state.firstGroup; g < state.firstGroup + state.groupCount; g++) {
+            const ConditionGroup &group = groups[g];
+            bool anyWeight = false;
+            for (int i = group.first; i < group.first + group.count; i++) anyWeight = anyWeight || transitions[i].probability > 0;
+
+            for (int i = group.first; i < group.first + group.count; i++) {
+                const Transition &transition = transitions[i];
+                std::string where = "state " + stateNames[s] + ": transition to " + stateNames[transition.to] +
+                                    " (" + ConditionName(transition) + ")";
+                if (anyWeight ? transition.probability <= 0 : i != group.first) {
+                    out << "warning: " << where << " has probability 0, it's never taken" << std::endl;
+                    live[i] = false;
+                } else if (transition.condition == Condition::RandomInterval && (transition.intervalMin <= 0 || transition.intervalMax <= 0)) {
+                    out << "warning: " << where << " has no intervalMin/intervalMax, it's never armed" << std::endl;
+                    live[i] = false;
+                }
+                for (int k = group.first; k < i; k++) {
+                    if (transitions[k].to == transition.to && transition.condition != Condition::SetInterval &&
+                        transition.condition != Condition::RandomInterval) {
+                        out << "warning: " << where << " repeats an earlier one, merge their probabilities" << std::endl;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Something has to be drawn from the start
+    bool animated = std::any_of(regions.begin(), regions.end(), [&](const Region &region) { return states[region.initial].animation >= 0; });
+    if (!animated) {
+        out << "error: no region starts in a state with an animation" << std::endl;
+        errors++;
+    }
+
+    // Everything has to be reachable from its region's initial state over transitions that can be taken
+    std::vector<bool> reached(states.size(), false);
+    std::vector<int> pending;
+    for (const auto &region : regions) {
+        reached[region.initial] = true;
+        pending.push_back(region.initial);
+    }
+    while (!pending.empty()) {
+        const State &state = states[pending.back()];
+        pending.pop_back();
+        for (int i = state.firstTransition; i < state.firstTransition + state.transitionCount; i++) {
+            if (!live[i] || reached[transitions[i].to]) continue;
+            reached[transitions[i].to] = true;
+            pending.push_back(transitions[i].to);
+        }
+    }
+    for (const auto &region : regions) {
+        for (int s = region.firstState; s < region.firstState + region.stateCount; s++) {
+            if (!reached[s]) out << "warning: state " << stateNames[s] << " can't be reached from " << stateNames[region.initial] << std::endl;
+        }
+    }
+    return errors;
+}
+
+uint8_t StateMachine::ConditionEvents(Condition condition) {
+    switch (condition) {
+    case Condition::AtEndOfScreen:
+    case Condition::AtStartOfScreen:
+        return EVENT_POSITION;
+    case Condition::RandomInterval:
+    case Condition::SetInterval:
+        return EVENT_TIME;
+    case Condition::OnClick:
+        return EVENT_INPUT;
+    case Condition::AnimationEnd:
+        return EVENT_ANIMATION_END;
+    case Condition::Expression:
+    case Condition::Plugin:
+        break; // Depends on what it reads, see ExpressionProgram::events and ConditionRegistry::Entry::events
+    }
+    return EVENT_ALL;
+}
+
+const char *StateMachine::ConditionName(Condition condition) {
+    int index = static_cast<int>(condition);
+    return index < CONDITION_COUNT ? CONDITION_NAMES[index] : "unknown";
+}
+
+std::string StateMachine::ConditionName(const Transition &transition) const {
+    return transition.condition == Condition::Plugin ? pluginNames[transition.plugin] : ConditionName(transition.condition);
+}
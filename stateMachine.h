@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iosfwd>
+#include "aliasTable.h"
+#include "expression.h"
+
+class ConditionRegistry;
+
+// Transition conditions, resolved from their JSON names once when the state machine is compiled.
+// Expression is a "when" expression instead of a named condition (see expression.h), Plugin one
+// registered with a ConditionRegistry.
+enum class Condition : uint8_t { AtEndOfScreen, AtStartOfScreen, RandomInterval, SetInterval, OnClick, AnimationEnd, Expression, Plugin };
+
+// What can change a condition's outcome. Conditions are only re-evaluated on a step after one of
+// their events happened, so a state costs nothing while nothing it waits on changes.
+const uint8_t EVENT_INPUT = 1;         // A click
+const uint8_t EVENT_POSITION = 2;      // Position, size or world bounds changed
+const uint8_t EVENT_TIME = 4;          // A timed transition's timer expired
+const uint8_t EVENT_ANIMATION_END = 8; // The state's animation played through once
+const uint8_t EVENT_STEP = 16;         // Every step, for expressions reading the time or rolling dice
+const uint8_t EVENT_STATE = 32;        // A region entered a state (so also on entering this one): for in(), vx/vy
+const uint8_t EVENT_ALL = 63;
+
+// The behaviour graph of stateMachine.json flattened into index tables: each state is a range of
+// condition groups and transitions, so running it never touches a string.
+// States can nest: only the innermost ones exist here, each with its own transitions followed by those
+// of its enclosing states that it doesn't override, so inheriting costs nothing at runtime.
+// Orthogonal regions each have a state of their own at the same time; their states are contiguous.
+// The tables are plain fixed-size records, and the precompiled form smc writes is just them laid
+// end to end, so loading that is one read and a few copies.
+class StateMachine
+{
+public:
+    struct Transition
+    {
+        int32_t to = -1;         // Index into states
+        Condition condition = Condition::AtEndOfScreen;
+        uint8_t unused[3] = {};
+        float probability = 1.0f;
+        int32_t intervalMin = 0; // Minimum wait time for "randomInterval"
+        int32_t intervalMax = 0; // Maximum wait time for "randomInterval"
+        int32_t intervalSet = 0; // Exact wait time for "setInterval"
+        int32_t expression = -1; // Index into expressions for Condition::Expression
+        int32_t plugin = -1;     // Index into pluginNames for Condition::Plugin
+    };
+    // A state's transitions sharing a condition; when it holds one of them is picked by weight
+    struct ConditionGroup
+    {
+        Condition condition = Condition::AtEndOfScreen;
+        uint8_t events = 0;      // EVENT_* its condition depends on
+        uint8_t unused[2] = {};
+        int32_t first = 0;       // Range in transitions, and of its alias table in aliases
+        int32_t count = 0;
+        int32_t expression = -1; // Index into expressions for Condition::Expression
+        int32_t plugin = -1;     // Index into pluginNames for Condition::Plugin
+    };
+    // A state's transitions are stored grouped by condition
+    struct State
+    {
+        int32_t animation = -1;  // Index into animationNames, -1 to keep playing what's playing
+        int32_t firstTransition = 0, transitionCount = 0;
+        int32_t firstGroup = 0, groupCount = 0;
+        uint8_t events = 0;      // Union of its groups' events
+        uint8_t unused[3] = {};
+    };
+    struct Region
+    {
+        int32_t initial = 0;     // State it starts in
+        int32_t firstState = 0, stateCount = 0;
+    };
+
+    std::vector<State> states;
+    std::vector<Region> regions; // At least one
+    std::vector<ConditionGroup> groups;
+    std::vector<Transition> transitions;
+    std::vector<AliasEntry> aliases;         // Each group's alias table over its transitions' probabilities
+    std::vector<ExpressionProgram> expressions; // "when" expressions, each distinct one once
+    std::vector<ExpressionInstruction> expressionCode;
+    std::vector<float> expressionConstants;
+    std::vector<std::string> stateNames;     // Only for messages
+    std::vector<std::string> animationNames; // Looked up among the loaded animations by the sprite
+    std::vector<std::string> pluginNames;    // Registered conditions, looked up by the sprite too
+    std::vector<std::string> warnings;       // Found by LoadJson, for Validate to report
+
+    // Compiles stateMachine.json. Transitions to unknown states, with unknown conditions, with
+    // expressions that don't compile or with fields missing or of the wrong type are reported on
+    // std::cerr and left out; returns false if there were any, or it couldn't be read. Conditions that aren't built in are looked up in conditions.
+    bool LoadJson(const std::string &path, const ConditionRegistry *conditions = nullptr);
+    // The precompiled form (see smc.cpp); false if it can't be read or isn't a valid one
+    bool LoadBinary(const std::string &path);
+    bool SaveBinary(const std::string &path) const;
+    // Either, told apart by the first bytes
+    bool Load(const std::string &path, const ConditionRegistry *conditions = nullptr);
+    // From the constexpr tables smc --header generates (see compiledTables.h)
+    template <typename Tables> void LoadTables();
+    void Clear();
+
+    // Reports animations that aren't among knownAnimations as errors, and unreachable states,
+    // transitions that can never be taken and overridden ones as warnings. Returns the number of errors.
+    int Validate(const std::vector<std::string> &knownAnimations, std::ostream &out) const;
+
+    static uint8_t ConditionEvents(Condition condition);
+    static const char *ConditionName(Condition condition);
+    std::string ConditionName(const Transition &transition) const; // With a plugin condition's own name
+};
+
+template <typename Tables>
+void StateMachine::LoadTables() {
+    Clear();
+    states.assign(Tables::states.begin(), Tables::states.end());
+    regions.assign(Tables::regions.begin(), Tables::regions.end());
+    groups.assign(Tables::groups.begin(), Tables::groups.end());
+    transitions.assign(Tables::transitions.begin(), Tables::transitions.end());
+    aliases.assign(Tables::aliases.begin(), Tables::aliases.end());
+    expressions.assign(Tables::expressions.begin(), Tables::expressions.end());
+    expressionCode.assign(Tables::expressionCode.begin(), Tables::expressionCode.end());
+    expressionConstants.assign(Tables::expressionConstants.begin(), Tables::expressionConstants.end());
+    stateNames.assign(Tables::stateNames.begin(), Tables::stateNames.end());
+    animationNames.assign(Tables::animationNames.begin(), Tables::animationNames.end());
+    pluginNames.assign(Tables::pluginNames.begin(), Tables::pluginNames.end());
+}
@@ -0,0 +1,126 @@
+// Checks every blitter kernel the CPU supports against the scalar one: BlendRow and BlendRowMirrored on all
+// lengths up to a few vectors (so every tail is hit), and BlendImage / BlendImageSpans clipped at the surface
+// edges, plain and mirrored.
+// Exits 1 on the first mismatch. Built and run by `make -f headless.mk test`.
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include "blitter.h"
+
+namespace {
+
+std::mt19937 generator(1);
+
+// Premultiplied BGRA with mostly transparent and opaque pixels, like a sprite, and some of everything else
+uint32_t RandomPixel() {
+    uint32_t alpha;
+    switch (generator() % 4) {
+        case 0: alpha = 0; break;
+        case 1: alpha = 255; break;
+        default: alpha = generator() % 256; break;
+    }
+    uint32_t pixel = alpha << 24;
+    for (int shift = 0; shift < 24; shift += 8) {
+        pixel |= (alpha ? generator() % (alpha + 1) : 0) << shift;
+    }
+    return pixel;
+}
+
+std::vector<uint32_t> RandomPixels(size_t count) {
+    std::vector<uint32_t> pixels(count);
+    for (uint32_t &pixel : pixels) pixel = RandomPixel();
+    return pixels;
+}
+
+// What BlendImage should produce, pixel by pixel with the scalar kernel
+void ReferenceBlend(std::vector<uint32_t> &dst, int dstWidth, int dstHeight, int x, int y,
+                    const std::vector<uint32_t> &src, int srcWidth, int srcHeight, bool mirror) {
+    for (int row = 0; row < srcHeight; row++) {
+        for (int column = 0; column < srcWidth; column++) {
+            int dx = x + column, dy = y + row;
+            if (dx < 0 || dy < 0 || dx >= dstWidth || dy >= dstHeight) continue;
+            int srcColumn = mirror ? srcWidth - 1 - column : column;
+            BlendRowScalar(&dst[static_cast<size_t>(dy) * dstWidth + dx], &src[static_cast<size_t>(row) * srcWidth + srcColumn], 1);
+        }
+    }
+}
+
+bool CheckRows(BlitPath path) {
+    for (int count = 0; count <= 67; count++) {
+        for (int trial = 0; trial < 20; trial++) {
+            std::vector<uint32_t> src = RandomPixels(count), dst = RandomPixels(count);
+            std::vector<uint32_t> expected = dst;
+            BlendRowScalar(expected.data(), src.data(), count);
+            BlendRow(dst.data(), src.data(), count);
+            if (dst != expected) {
+                std::cerr << GetBlitPathName(path) << ": BlendRow differs from scalar for " << count << " pixels" << std::endl;
+                return false;
+            }
+
+            std::vector<uint32_t> mirrored = RandomPixels(count), reversed(src.rbegin(), src.rend());
+            expected = mirrored;
+            BlendRowScalar(expected.data(), reversed.data(), count);
+            BlendRowMirrored(mirrored.data(), src.data(), count);
+            if (mirrored != expected) {
+                std::cerr << GetBlitPathName(path) << ": BlendRowMirrored differs from scalar for " << count << " pixels" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CheckImages(BlitPath path) {
+    const int SURFACE_WIDTH = 64, SURFACE_HEIGHT = 48;
+    const int OFFSETS[] = { -40, -13, -1, 0, 5, 31, 50, 63 };
+    for (int srcWidth : { 1, 7, 33, 45 }) {
+        for (int srcHeight : { 1, 19 }) {
+            std::vector<uint32_t> src = RandomPixels(static_cast<size_t>(srcWidth) * srcHeight);
+            AlphaSpans spans;
+            EncodeAlphaSpans(src.data(), srcWidth, srcHeight, srcWidth, spans);
+            for (int x : OFFSETS) {
+                for (int y : OFFSETS) {
+                    for (bool mirror : { false, true }) {
+                        std::vector<uint32_t> background = RandomPixels(static_cast<size_t>(SURFACE_WIDTH) * SURFACE_HEIGHT);
+                        std::vector<uint32_t> expected = background;
+                        ReferenceBlend(expected, SURFACE_WIDTH, SURFACE_HEIGHT, x, y, src, srcWidth, srcHeight, mirror);
+
+                        std::vector<uint32_t> image = background, spanned = background;
+                        Surface surface;
+                        surface.width = SURFACE_WIDTH;
+                        surface.height = SURFACE_HEIGHT;
+                        surface.stride = SURFACE_WIDTH;
+                        surface.pixels = image.data();
+                        BlendImage(surface, x, y, src.data(), srcWidth, srcHeight, srcWidth, mirror);
+                        surface.pixels = spanned.data();
+                        BlendImageSpans(surface, x, y, src.data(), srcWidth, spans, mirror);
+
+                        if (image != expected || spanned != expected) {
+                            std::cerr << GetBlitPathName(path) << ": " << (image != expected ? "BlendImage" : "BlendImageSpans")
+                                      << " differs from scalar for a " << (mirror ? "mirrored " : "") << srcWidth << "x" << srcHeight << " image at "
+                                      << x << "," << y << std::endl;
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    for (BlitPath path : { BlitPath::Scalar, BlitPath::SSE2, BlitPath::AVX2 }) {
+        SetBlitPath(path);
+        if (GetBlitPath() != path) {
+            std::cout << GetBlitPathName(path) << ": not supported, skipped" << std::endl;
+            continue;
+        }
+        if (!CheckRows(path) || !CheckImages(path)) return 1;
+        std::cout << GetBlitPathName(path) << ": OK" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Checks the "when" expression compiler and interpreter: precedence and associativity, && and || skipping
+// their right side (rand() and clicked() aren't run there), the events each expression is tested after, the
+// messages for what doesn't compile, and CheckExpression rejecting bytecode that reaches out of range.
+// Exits 1 on failure.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include "expression.h"
+#include "stateMachine.h"
+
+namespace {
+
+int failures = 0;
+
+void Expect(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// State a is numbered 0, b 1 and group, which has both inside it, 0 and 1
+const ExpressionStates STATES = { { "a", { 0, 1 } }, { "b", { 1, 1 } }, { "group", { 0, 2 } } };
+
+struct Compiled
+{
+    std::vector<ExpressionInstruction> code;
+    std::vector<float> constants;
+    ExpressionProgram program;
+    std::string error;
+    bool ok = false;
+
+    explicit Compiled(const std::string &text) { ok = CompileExpression(text, code, constants, program, error, &STATES); }
+};
+
+struct Context
+{
+    ExpressionContext context;
+    std::mt19937 random{ 1 };
+    bool clicked = false;
+    int32_t activeStates[1] = { 1 };
+
+    Context() {
+        context.random = &random;
+        context.clicked = &clicked;
+        context.activeStates = activeStates;
+        context.activeStateCount = 1;
+    }
+    void Set(ExpressionVariable variable, float value) { context.variables[static_cast<int>(variable)] = value; }
+};
+
+bool Holds(const std::string &text, Context &context) {
+    Compiled compiled(text);
+    if (!compiled.ok) {
+        Expect(false, "\"" + text + "\" compiles: " + compiled.error);
+        return false;
+    }
+    Expect(CheckExpression(compiled.program, compiled.code, compiled.constants.size()), "\"" + text + "\" passes CheckExpression");
+    return RunExpression(compiled.code.data(), compiled.constants.data(), compiled.program, context.context);
+}
+
+void CheckEvaluation() {
+    Context context;
+    for (const char *text : { "1 || 0 && 0", "1-2-3 == -4", "2 + 3 * 4 == 14", "(2 + 3) * 4 == 20", "12 / 4 / 3 == 1",
+                              "-2 * -3 == 6", "!0", "!!3", "1 < 2 == 1", "3 > 2 > 1 == 0", "1 != 2", "2 <= 2 && 2 >= 2",
+                              "1e3 == 1000", ".5 + 0.5 == 1", "0 || 0 || 4", "in(b) && in(group) && !in(a)" }) {
+        Expect(Holds(text, context), "\"" + std::string(text) + "\" holds");
+    }
+    for (const char *text : { "0", "(1 || 0) && 0", "1 && 0 || 0", "2 - 2", "1 > 2" }) {
+        Expect(!Holds(text, context), "\"" + std::string(text) + "\" doesn't hold");
+    }
+
+    context.Set(ExpressionVariable::X, 0);
+    Expect(Holds("!(x > 1)", context), "\"!(x > 1)\" holds at x = 0");
+    context.Set(ExpressionVariable::X, 2);
+    Expect(!Holds("!(x > 1)", context), "\"!(x > 1)\" doesn't hold at x = 2");
+    context.Set(ExpressionVariable::ScreenW, 1000);
+    Expect(Holds("x * 500 == screenW", context), "variables are read");
+}
+
+void CheckShortCircuit() {
+    Context context;
+    std::mt19937 before = context.random;
+    Expect(!Holds("0 && rand() < 2", context), "\"0 && rand() < 2\" doesn't hold");
+    Expect(Holds("1 || rand() < 2", context), "\"1 || rand() < 2\" holds");
+    Expect(context.random == before, "rand() isn't rolled on the side && and || skip");
+    Expect(Holds("1 && rand() < 2", context), "\"1 && rand() < 2\" holds");
+    Expect(context.random != before, "rand() is rolled when it's reached");
+
+    context.clicked = true;
+    Expect(!Holds("0 && clicked()", context), "\"0 && clicked()\" doesn't hold");
+    Expect(context.clicked, "a skipped clicked() leaves the click for later");
+    Expect(Holds("1 && clicked()", context), "\"1 && clicked()\" holds after a click");
+    Expect(!context.clicked, "clicked() takes the click");
+}
+
+void CheckEvents() {
+    const std::pair<const char *, uint8_t> EXPECTED[] = {
+        { "x > 1", EVENT_POSITION },
+        { "rand() < 0.5", EVENT_STEP },
+        { "0 && rand()", EVENT_STEP }, // Skipped at runtime, but it's in there
+        { "clicked()", EVENT_INPUT },
+        { "elapsed > 100 || animationEnd", EVENT_STEP | EVENT_ANIMATION_END },
+        { "vx < 0 && in(a)", EVENT_STATE },
+        { "1", EVENT_STATE }, // Reads nothing, tested when its state is entered
+    };
+    for (const auto &[text, events] : EXPECTED) {
+        Compiled compiled(text);
+        Expect(compiled.ok && compiled.program.events == events,
+               "\"" + std::string(text) + "\" is tested after events " + std::to_string(events) + ", not " + std::to_string(compiled.program.events));
+    }
+}
+
+void CheckErrors() {
+    const std::pair<const char *, const char *> EXPECTED[] = {
+        { "x >", "unexpected end at column 4" },
+        { "foo()", "unknown function foo at column 1" },
+        { "foo", "unknown variable foo at column 1" },
+        { "(1 + 2", "missing ')' at column 7" },
+        { "1 2", "unexpected '2' at column 3" },
+        { "rand(1)", "rand() takes no arguments" },
+        { "in(nowhere)", "unknown state 'nowhere' at column 4" },
+        { "0x10", "bad number at column 2" },
+        { "1e", "bad number at column 2" },
+        { "inf > 1", "unknown variable inf" },
+        { "x @ 1", "unexpected '@' at column 3" },
+    };
+    for (const auto &[text, message] : EXPECTED) {
+        std::vector<ExpressionInstruction> code(3);
+        std::vector<float> constants(2);
+        ExpressionProgram program;
+        std::string error;
+        bool ok = CompileExpression(text, code, constants, program, error, &STATES);
+        Expect(!ok && error.find(message) != std::string::npos,
+               "\"" + std::string(text) + "\" fails with \"" + message + "\", got \"" + error + "\"");
+        Expect(code.size() == 3 && constants.size() == 2, "\"" + std::string(text) + "\" leaves code and constants as they were");
+    }
+}
+
+void CheckBytecode() {
+    Compiled compiled("x > 1 && in(a) || rand() < 0.5");
+    if (!compiled.ok) {
+        Expect(false, "compiling the bytecode test expression");
+        return;
+    }
+    Expect(CheckExpression(compiled.program, compiled.code, compiled.constants.size()), "compiled bytecode passes CheckExpression");
+
+    auto rejected = [&](const char *what, const std::function<void(Compiled &)> &corrupt) {
+        Compiled copy = compiled;
+        corrupt(copy);
+        Expect(!CheckExpression(copy.program, copy.code, copy.constants.size()), std::string("CheckExpression rejects ") + what);
+    };
+    auto first = [](Compiled &c, ExpressionOp op) -> ExpressionInstruction & {
+        for (auto &instruction : c.code) {
+            if (instruction.op == op) return instruction;
+        }
+        return c.code[0];
+    };
+    rejected("a program past the end of the code", [](Compiled &c) { c.program.instructionCount++; });
+    rejected("an empty program", [](Compiled &c) { c.program.instructionCount = 0; });
+    rejected("constants past the end", [](Compiled &c) { c.program.constantCount++; });
+    rejected("an unknown instruction", [](Compiled &c) { c.code[0].op = static_cast<ExpressionOp>(static_cast<int>(ExpressionOp::JumpIfTrue) + 1); });
+    rejected("a register out of range", [](Compiled &c) { c.code[0].dst = EXPRESSION_REGISTERS; });
+    rejected("a constant out of range", [&](Compiled &c) { first(c, ExpressionOp::Constant).operand = c.program.constantCount; });
+    rejected("an in() range running off the constants", [&](Compiled &c) { first(c, ExpressionOp::InState).operand = c.program.constantCount - 1; });
+    rejected("an unknown variable", [&](Compiled &c) { first(c, ExpressionOp::Variable).a = static_cast<uint8_t>(ExpressionVariable::Count); });
+    rejected("a jump backwards", [&](Compiled &c) { first(c, ExpressionOp::JumpIfFalse).operand = 0; });
+    rejected("a jump past the end", [&](Compiled &c) { first(c, ExpressionOp::JumpIfTrue).operand = c.program.instructionCount + 1; });
+}
+
+}
+
+int main() {
+    CheckEvaluation();
+    CheckShortCircuit();
+    CheckEvents();
+    CheckErrors();
+    CheckBytecode();
+    if (failures > 0) return 1;
+    std::cout << "Expressions: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,45 @@
+// Checks MonitorLayout::MoveOntoMonitor, which main.cpp uses to put the sprite back on a monitor after the
+// display setup changes: rects already on a monitor stay, ones across a seam or in the gap an L-shaped layout
+// leaves in its bounding box move onto the closest monitor. Exits 1 on failure.
+#include <iostream>
+#include <string>
+#include "monitorLayout.h"
+
+namespace {
+
+int failures = 0;
+
+void ExpectMoved(const MonitorLayout &layout, const ScreenRect &rect, int left, int top, const std::string &what) {
+    ScreenRect moved = layout.MoveOntoMonitor(rect);
+    if (moved.left != left || moved.top != top || moved.Width() != rect.Width() || moved.Height() != rect.Height()) {
+        std::cerr << "FAILED: " << what << ": moved to " << moved.left << "," << moved.top << " instead of "
+                  << left << "," << top << std::endl;
+        failures++;
+    }
+}
+
+}
+
+int main() {
+    // A 1920x1080 primary with a taller 2560x1440 monitor to its right, raised by 200 pixels
+    MonitorLayout layout;
+    if (!layout.Parse("1920x1080+0+0,2560x1440+1920-200")) {
+        std::cerr << "FAILED: parsing the test layout" << std::endl;
+        return 1;
+    }
+    ExpectMoved(layout, { 100, 800, 250, 950 }, 100, 800, "a rect on the primary stays");
+    ExpectMoved(layout, { 3000, -150, 3150, 0 }, 3000, -150, "a rect on the raised monitor stays");
+    ExpectMoved(layout, { 1800, 500, 1950, 650 }, 1770, 500, "a rect across the seam moves onto the monitor it's mostly on");
+    ExpectMoved(layout, { 100, -150, 250, 0 }, 100, 0, "a rect above the primary, inside the bounding box, moves down onto it");
+    ExpectMoved(layout, { 1000, 1100, 1150, 1250 }, 1000, 930, "a rect below the primary moves up onto it");
+    ExpectMoved(layout, { 5000, 2000, 5150, 2150 }, 4330, 1090, "a rect off every monitor moves onto the nearest");
+
+    // The monitor the sprite was on is unplugged
+    layout.Parse("1920x1080+0+0");
+    ExpectMoved(layout, { 3000, -150, 3150, 0 }, 1770, 0, "a rect on a monitor that went away moves onto the remaining one");
+    ExpectMoved(layout, { -50, -50, 2000, 1200 }, 0, 0, "a rect bigger than the monitor goes to its top-left corner");
+
+    if (failures > 0) return 1;
+    std::cout << "Monitor layout: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Drives a sprite the way the Windows main loop does, sleeping for whatever TickScheduler says the next
+// deadline allows, but on a ManualClock, and checks every wakeup lands on the expected tick: frame changes
+// and timed transitions rounded up to the simulation step they fall on, nothing in between. Also runs it
+// across the 32-bit millisecond wrap. Exits 1 on the first mismatch. Run from the repo root (it loads animations/).
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "sprite.h"
+#include "scheduler.h"
+
+namespace {
+
+int failures = 0;
+
+void Expect(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+void CheckScheduler() {
+    TickScheduler scheduler(16);
+    Deadline idle;
+    Expect(scheduler.GetDelay(idle, 1000) == TickScheduler::NO_WAKEUP, "nothing pending sleeps until input");
+
+    Deadline later;
+    later.Add(1500);
+    later.Add(1200); // The earlier one wins
+    later.Add(1300);
+    Expect(later.time == 1200, "Deadline::Add keeps the earliest time");
+    Expect(scheduler.GetDelay(later, 1000) == 200, "waits until the deadline");
+    Expect(scheduler.GetDelay(later, 1250) == 0, "an overdue deadline ticks right away");
+    later.continuous = true;
+    Expect(scheduler.GetDelay(later, 1000) == 16, "moving ticks at the fixed rate");
+
+    // 0xFFFFFFF0 is before 0x10 once the counter wraps
+    Deadline wrapped;
+    wrapped.Add(0x10);
+    wrapped.Add(0xFFFFFFF0);
+    Expect(wrapped.time == 0xFFFFFFF0, "Deadline::Add compares across the wrap");
+    wrapped = Deadline();
+    wrapped.Add(0x10);
+    Expect(scheduler.GetDelay(wrapped, 0xFFFFFFF0) == 0x20, "the delay counts across the wrap");
+}
+
+// Rounded up to the simulation step it happens on, like Sprite::GetNextDeadline does
+uint32_t StepAfter(uint32_t ms) {
+    return (ms + Sprite::SIM_STEP_MS - 1) / Sprite::SIM_STEP_MS * Sprite::SIM_STEP_MS;
+}
+
+// Two states playing spinRight (four 150ms frames, looping, not moving) that switch to each other after
+// a setInterval of 1000ms
+void CheckSpriteWakeups(const std::string &machinePath, uint32_t startMs) {
+    const uint32_t FRAME_MS = 150, INTERVAL_MS = 1000;
+    ManualClock clock(static_cast<uint64_t>(startMs) * 1000000);
+    Sprite sprite(1920, 1080, clock);
+    sprite.LoadAnimations("animations");
+    if (!sprite.LoadStateMachine(machinePath)) {
+        Expect(false, "loading the test state machine");
+        return;
+    }
+    sprite.SetHeight(150);
+    sprite.SetPosition(100, 100);
+
+    // Each state is entered on a step, its frames change every FRAME_MS from there and it leaves on the
+    // step after INTERVAL_MS, where the next state starts over
+    std::vector<uint32_t> expected;
+    uint32_t entered = 0;
+    while (expected.size() < 30) {
+        for (uint32_t change = FRAME_MS; change < INTERVAL_MS; change += FRAME_MS) {
+            expected.push_back(entered + StepAfter(change));
+        }
+        entered += StepAfter(INTERVAL_MS);
+        expected.push_back(entered);
+    }
+
+    TickScheduler scheduler(16);
+    sprite.Update();
+    for (size_t i = 0; i < expected.size(); i++) {
+        Deadline deadline = sprite.GetNextDeadline();
+        Expect(!deadline.continuous, "a sprite standing still doesn't need the fixed rate");
+        uint32_t delay = scheduler.GetDelay(deadline, clock.NowMs());
+        uint32_t wakeup = clock.NowMs() + delay - startMs;
+        if (delay == TickScheduler::NO_WAKEUP || wakeup != expected[i]) {
+            Expect(false, "starting at " + std::to_string(startMs) + " ms, wakeup " + std::to_string(i) + " is at " +
+                          std::to_string(wakeup) + " ms instead of " + std::to_string(expected[i]));
+            return;
+        }
+        clock.AdvanceMs(delay);
+        sprite.Update();
+    }
+}
+
+// walkRight moves every step, so it has to be ticked at the scheduler's rate whatever else is pending
+void CheckMovingSprite() {
+    ManualClock clock;
+    Sprite sprite(1920, 1080, clock);
+    sprite.LoadAnimations("animations");
+    if (!sprite.LoadStateMachine("stateMachine.json")) {
+        Expect(false, "loading stateMachine.json");
+        return;
+    }
+    sprite.SetHeight(150);
+    sprite.SetPosition(100, 100);
+    sprite.Update();
+    TickScheduler scheduler(10);
+    Deadline deadline = sprite.GetNextDeadline();
+    Expect(deadline.continuous, "a walking sprite needs the fixed rate");
+    Expect(scheduler.GetDelay(deadline, clock.NowMs()) == 10, "a walking sprite wakes every fixed interval");
+}
+
+}
+
+int main() {
+    std::string machinePath = (std::filesystem::temp_directory_path() / "schedulerTest.json").string();
+    std::ofstream(machinePath) << R"({
+        "a": { "animation": "spinRight", "transitions": [ { "to": "b", "condition": "setInterval", "intervalSet": 1000 } ] },
+        "b": { "animation": "spinRight", "transitions": [ { "to": "a", "condition": "setInterval", "intervalSet": 1000 } ] }
+    })";
+
+    CheckScheduler();
+    for (uint32_t startMs : { 0u, 4294967000u }) {
+        CheckSpriteWakeups(machinePath, startMs);
+    }
+    CheckMovingSprite();
+    std::filesystem::remove(machinePath);
+
+    if (failures > 0) return 1;
+    std::cout << "Scheduler: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,246 @@
+// Checks how nested states are flattened: own transitions first, then each enclosing state's, nearer ones
+// overriding the same condition or "when", targets resolved through "initial", and the overridden-everywhere
+// warning. Compiles a state machine with two regions, saves it the way smc does and checks LoadBinary takes it back,
+// then that it rejects copies with indices that are in range but point where they mustn't: a transition into
+// the other region, and a condition group reaching into the next state's transitions. Also checks a sprite
+// running a precompiled machine asks a plugin condition after the events the plugin registered now, not the
+// ones stored when it was compiled, and that transitions with fields missing or of the wrong type are reported
+// and skipped instead of aborting the load. Exits 1 on failure. Run from the repo root (it loads animations/).
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include "stateMachine.h"
+#include "sprite.h"
+
+namespace {
+
+const char *MACHINE = R"json({
+    "regions": {
+        "locomotion": {
+            "states": {
+                "walkRight": { "animation": "walkRight", "transitions": [ { "to": "walkLeft", "condition": "atEndOfScreen" },
+                                                                          { "to": "spinning", "condition": "onClick" } ] },
+                "walkLeft": { "animation": "walkLeft", "transitions": [ { "to": "walkRight", "condition": "atStartOfScreen" } ] },
+                "spinning": { "animation": "spinRight", "transitions": [ { "to": "walkRight", "condition": "animationEnd" } ] }
+            }
+        },
+        "mood": {
+            "states": {
+                "calm": { "transitions": [ { "to": "excited", "when": "in(spinning)" } ] },
+                "excited": { "transitions": [ { "to": "calm", "condition": "setInterval", "intervalSet": 3000 } ] }
+            }
+        }
+    }
+})json";
+
+// walk, standing and sitting inherit from root, standing and sitting from idle too; spin is outside them
+const char *NESTED_MACHINE = R"json({
+    "root": {
+        "initial": "idle",
+        "transitions": [ { "to": "spin", "condition": "onClick" },
+                         { "to": "idle", "condition": "animationEnd" },
+                         { "to": "spin", "when": "x > 5" },
+                         { "to": "spin", "condition": "atStartOfScreen" } ],
+        "states": {
+            "walk": { "animation": "walkRight", "transitions": [ { "to": "standing", "condition": "atEndOfScreen" },
+                                                                 { "to": "walk", "condition": "animationEnd" },
+                                                                 { "to": "walk", "condition": "atStartOfScreen" } ] },
+            "idle": {
+                "initial": "sitting",
+                "transitions": [ { "to": "walk", "when": "x > 5" } ],
+                "states": {
+                    "standing": { "animation": "spinRight", "transitions": [ { "to": "sitting", "condition": "atStartOfScreen" } ] },
+                    "sitting": { "animation": "spinRight", "transitions": [ { "to": "standing", "condition": "onClick" },
+                                                                            { "to": "walk", "condition": "atStartOfScreen" } ] }
+                }
+            }
+        }
+    },
+    "spin": { "animation": "spinRight", "transitions": [ { "to": "root", "condition": "animationEnd" } ] }
+})json";
+
+int StateIndex(const StateMachine &machine, const std::string &name) {
+    for (size_t i = 0; i < machine.stateNames.size(); i++) {
+        if (machine.stateNames[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+const char *PLUGIN_MACHINE = R"json({
+    "walkLeft": { "animation": "walkLeft", "transitions": [ { "to": "spin", "condition": "leftOf" } ] },
+    "spin": { "animation": "spinRight" }
+})json";
+
+int LeftOf(const ConditionInputs *inputs, void *x) { return inputs->x < *static_cast<float *>(x); }
+
+// Compiled against a leftOf that claims to depend on input only, run with one that depends on the position:
+// the sprite has to stop walking (spin) once it's left of the line, instead of never asking again
+bool CheckPluginEvents(const std::string &folder) {
+    std::string jsonPath = folder + "/pluginEventsTest.json", binaryPath = folder + "/pluginEventsTest.bin";
+    std::ofstream(jsonPath) << PLUGIN_MACHINE;
+    static float line = 1000;
+    ConditionRegistry compiledWith;
+    compiledWith.Register("leftOf", LeftOf, EVENT_INPUT, &line);
+    StateMachine compiled;
+    bool ok = compiled.LoadJson(jsonPath, &compiledWith) && compiled.SaveBinary(binaryPath);
+
+    ManualClock clock;
+    Sprite sprite(1920, 1080, clock);
+    ok = ok && ConditionRegistry::Global().Register("leftOf", LeftOf, EVENT_POSITION, &line);
+    sprite.LoadAnimations("animations");
+    ok = ok && sprite.LoadStateMachine(binaryPath);
+    sprite.SetHeight(150);
+    sprite.SetPosition(1500, 500);
+    for (int step = 0; ok && step < 1000; step++) {
+        clock.AdvanceMs(Sprite::SIM_STEP_MS);
+        sprite.Update();
+    }
+    std::filesystem::remove(jsonPath);
+    std::filesystem::remove(binaryPath);
+    return ok && sprite.GetX() < line && sprite.GetX() > line - 100;
+}
+
+// A state's flattened transitions as "condition>target", in the order they're stored
+std::string DescribeTransitions(const StateMachine &machine, const std::string &state) {
+    std::string description;
+    const StateMachine::State &flat = machine.states[StateIndex(machine, state)];
+    for (int i = flat.firstTransition; i < flat.firstTransition + flat.transitionCount; i++) {
+        const StateMachine::Transition &transition = machine.transitions[i];
+        description += (description.empty() ? "" : " ") + machine.ConditionName(transition) + ">" + machine.stateNames[transition.to];
+    }
+    return description;
+}
+
+// Each innermost state gets its own transitions, then those of every state around it, nearest first, minus the
+// conditions (or "when" expressions) a nearer one already has; a compound target means its "initial" state
+bool CheckHierarchy(const std::string &folder) {
+    std::string jsonPath = folder + "/hierarchyTest.json";
+    std::ofstream(jsonPath) << NESTED_MACHINE;
+    StateMachine machine;
+    bool ok = machine.LoadJson(jsonPath);
+    std::filesystem::remove(jsonPath);
+    if (!ok || machine.states.size() != 4) {
+        std::cerr << "FAILED: compiling the nested state machine" << std::endl;
+        return false;
+    }
+
+    const std::pair<const char *, const char *> EXPECTED[] = {
+        { "walk", "atEndOfScreen>standing animationEnd>walk atStartOfScreen>walk onClick>spin when>spin" },
+        { "standing", "atStartOfScreen>sitting when>walk onClick>spin animationEnd>sitting" },
+        { "sitting", "onClick>standing atStartOfScreen>walk when>walk animationEnd>sitting" },
+        { "spin", "animationEnd>sitting" },
+    };
+    for (const auto &[state, expected] : EXPECTED) {
+        std::string got = DescribeTransitions(machine, state);
+        if (got != expected) {
+            std::cerr << "FAILED: " << state << " flattens to \"" << got << "\" instead of \"" << expected << "\"" << std::endl;
+            ok = false;
+        }
+    }
+    if (machine.regions.size() != 1 || machine.regions[0].initial != StateIndex(machine, "sitting")) {
+        std::cerr << "FAILED: the region starts in root's initial state's initial state, sitting" << std::endl;
+        ok = false;
+    }
+
+    // root's atStartOfScreen is overridden everywhere it's inherited, its "when" only in idle
+    const std::string OVERRIDDEN = "state root: transition to spin (atStartOfScreen) is overridden in every state inside it";
+    if (machine.warnings.size() != 1 || machine.warnings[0] != OVERRIDDEN) {
+        std::cerr << "FAILED: only root's atStartOfScreen transition is reported as overridden (" << machine.warnings.size()
+                  << " warnings)" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// Transitions that can't be read are reported and left out, not aborted on; the valid one after each is kept
+bool CheckMalformed(const std::string &folder) {
+    const char *BROKEN[] = {
+        R"({ "to": "b" })", // Neither a condition nor "when"
+        R"({ "condition": "onClick" })",
+        R"({ "to": "b", "conditon": "onClick" })",
+        R"({ "to": 3, "condition": "onClick" })",
+        R"({ "to": "b", "when": true })",
+        R"({ "to": "b", "condition": "onClick", "probability": "0.5" })",
+        R"({ "to": "b", "condition": "randomInterval", "intervalMin": 100, "intervalMax": [] })",
+        R"({ "to": "b", "condition": "setInterval", "intervalSet": null })",
+        R"("b")",
+    };
+    std::string jsonPath = folder + "/malformedTest.json";
+    bool ok = true;
+    for (const char *broken : BROKEN) {
+        std::ofstream(jsonPath) << R"({ "a": { "transitions": [ )" << broken
+                                << R"(, { "to": "b", "condition": "animationEnd" } ] }, "b": {} })";
+        StateMachine machine;
+        bool loaded = machine.LoadJson(jsonPath);
+        const StateMachine::State &a = machine.states[StateIndex(machine, "a")];
+        if (loaded || a.transitionCount != 1 || machine.transitions[a.firstTransition].condition != Condition::AnimationEnd) {
+            std::cerr << "FAILED: transition " << broken << std::endl;
+            ok = false;
+        }
+    }
+    std::ofstream(jsonPath) << R"({ "a": { "animation": 5 } })";
+    StateMachine machine;
+    if (machine.LoadJson(jsonPath)) {
+        std::cerr << "FAILED: an animation that isn't a name" << std::endl;
+        ok = false;
+    }
+    std::filesystem::remove(jsonPath);
+    return ok;
+}
+
+// Saves machine with corrupt applied and reports whether LoadBinary accepted it
+bool LoadsAfter(const StateMachine &source, const std::string &binaryPath, const std::function<void(StateMachine &)> &corrupt) {
+    StateMachine machine = source;
+    corrupt(machine);
+    if (!machine.SaveBinary(binaryPath)) return false;
+    StateMachine loaded;
+    return loaded.LoadBinary(binaryPath);
+}
+
+}
+
+int main() {
+    std::string folder = std::filesystem::temp_directory_path().string();
+    std::string jsonPath = folder + "/stateMachineTest.json", binaryPath = folder + "/stateMachineTest.bin";
+    std::ofstream(jsonPath) << MACHINE;
+
+    StateMachine machine;
+    if (!machine.LoadJson(jsonPath) || machine.regions.size() != 2) {
+        std::cerr << "FAILED: compiling the test state machine" << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    auto expect = [&](bool ok, const char *what) {
+        if (!ok) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    };
+
+    expect(LoadsAfter(machine, binaryPath, [](StateMachine &) {}), "a valid precompiled state machine loads");
+
+    std::cerr << "(Corrupt and malformed state machines are reported below, that's expected)" << std::endl;
+    expect(!LoadsAfter(machine, binaryPath, [](StateMachine &m) { m.transitions.back().to = static_cast<int32_t>(m.states.size()); }),
+           "a transition to a state that doesn't exist is rejected");
+    expect(!LoadsAfter(machine, binaryPath, [](StateMachine &m) {
+               const StateMachine::State &walkRight = m.states[StateIndex(m, "walkRight")];
+               m.transitions[walkRight.firstTransition].to = StateIndex(m, "calm");
+           }), "a transition into another region is rejected");
+    expect(!LoadsAfter(machine, binaryPath, [](StateMachine &m) {
+               // walkRight has two groups of one transition each; point its last one past its own transitions
+               const StateMachine::State &walkRight = m.states[StateIndex(m, "walkRight")];
+               m.groups[walkRight.firstGroup + walkRight.groupCount - 1].first = walkRight.firstTransition + walkRight.transitionCount;
+           }), "a condition group outside its state's transitions is rejected");
+
+    expect(CheckHierarchy(folder), "nested states are flattened with the nearest transitions first");
+    expect(CheckMalformed(folder), "transitions with missing or invalid fields are reported and left out");
+    expect(CheckPluginEvents(folder), "a plugin condition is asked after the events it registered at runtime");
+
+    std::filesystem::remove(jsonPath);
+    std::filesystem::remove(binaryPath);
+    if (failures > 0) return 1;
+    std::cout << "State machine: OK" << std::endl;
+    return 0;
+}
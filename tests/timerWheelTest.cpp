@@ -0,0 +1,134 @@
+// Fuzzes TimerWheel against a naive reference (a list of armed timers scanned on every call) with random
+// schedules, cancels and advances. Delays reach past the wheel's 2^24 ms range, so timers get parked on the
+// top level and re-filed, and the runs cross the 32-bit wrap of the tick count. Exits 1 on the first mismatch.
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include "timerWheel.h"
+
+namespace {
+
+// What the wheel should do: every armed timer due at or before the time advanced to fires
+struct ReferenceTimer
+{
+    TimerWheel::Handle handle;
+    uint32_t expiry;
+    uint32_t payload;
+};
+
+bool Fail(uint32_t seed, int step, const std::string &what) {
+    std::cerr << "Seed " << seed << ", step " << step << ": " << what << std::endl;
+    return false;
+}
+
+bool RunFuzz(uint32_t seed, uint32_t start, int steps) {
+    std::mt19937 generator(seed);
+    auto below = [&](uint32_t limit) { return static_cast<uint32_t>(generator() % limit); };
+
+    TimerWheel wheel(start);
+    std::vector<ReferenceTimer> armed;
+    std::vector<TimerWheel::Handle> stale; // Fired or cancelled, must be ignored from then on
+    std::vector<uint32_t> expired;
+    uint32_t now = start, nextPayload = 0;
+
+    for (int step = 0; step < steps; step++) {
+        uint32_t action = below(100);
+        if (action < 40) {
+            // Mostly near, some up to the top level's range and some beyond it; a few already overdue
+            uint32_t kind = below(100), delay;
+            if (kind < 50) delay = below(200);
+            else if (kind < 80) delay = below(1 << 18);
+            else if (kind < 92) delay = below(1 << 24);
+            else delay = (1 << 24) + below(1 << 27);
+            uint32_t expiry = kind < 3 ? now - below(1000) : now + delay;
+            uint32_t payload = nextPayload++;
+            armed.push_back({ wheel.Schedule(expiry, payload), expiry, payload });
+        } else if (action < 55) {
+            bool useStale = !stale.empty() && (armed.empty() || below(4) == 0);
+            if (useStale) {
+                if (wheel.Cancel(stale[below(static_cast<uint32_t>(stale.size()))])) {
+                    return Fail(seed, step, "cancelling a stale handle succeeded");
+                }
+            } else if (!armed.empty()) {
+                size_t i = below(static_cast<uint32_t>(armed.size()));
+                if (!wheel.Cancel(armed[i].handle)) return Fail(seed, step, "cancelling an armed timer failed");
+                stale.push_back(armed[i].handle);
+                armed.erase(armed.begin() + i);
+            }
+        } else {
+            uint32_t kind = below(100), by;
+            if (kind < 70) by = 1 + below(64);
+            else if (kind < 99) by = 1 + below(5000);
+            else by = 1 + below(1 << 25);
+            now += by;
+
+            expired.clear();
+            wheel.Advance(now, expired);
+
+            std::vector<ReferenceTimer> due;
+            for (size_t i = 0; i < armed.size();) {
+                if (static_cast<int32_t>(armed[i].expiry - now) <= 0) {
+                    due.push_back(armed[i]);
+                    stale.push_back(armed[i].handle);
+                    armed.erase(armed.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+            std::vector<uint32_t> expectedPayloads;
+            for (const auto &timer : due) expectedPayloads.push_back(timer.payload);
+            std::vector<uint32_t> gotPayloads = expired;
+            std::sort(expectedPayloads.begin(), expectedPayloads.end());
+            std::sort(gotPayloads.begin(), gotPayloads.end());
+            if (gotPayloads != expectedPayloads) {
+                return Fail(seed, step, "advancing to " + std::to_string(now) + " expired " + std::to_string(expired.size()) +
+                                        " timers instead of " + std::to_string(due.size()));
+            }
+
+            // In expiry order (timers due on the same tick in any order); overdue ones are due on the first tick
+            uint32_t base = now - by + 1, previous = 0;
+            for (size_t i = 0; i < expired.size(); i++) {
+                auto timer = std::find_if(due.begin(), due.end(), [&](const ReferenceTimer &t) { return t.payload == expired[i]; });
+                int32_t ahead = static_cast<int32_t>(timer->expiry - base);
+                uint32_t at = ahead > 0 ? static_cast<uint32_t>(ahead) : 0;
+                if (i > 0 && at < previous) return Fail(seed, step, "timers expired out of order");
+                previous = at;
+            }
+        }
+
+        if (wheel.GetActiveCount() != static_cast<int>(armed.size())) {
+            return Fail(seed, step, std::to_string(wheel.GetActiveCount()) + " timers armed instead of " + std::to_string(armed.size()));
+        }
+        uint32_t nextExpiry;
+        bool hasNext = wheel.GetNextExpiry(nextExpiry);
+        if (hasNext != !armed.empty()) return Fail(seed, step, "GetNextExpiry disagrees about whether anything is armed");
+        if (hasNext) {
+            // Earliest counting from the next tick, so overdue timers come first
+            uint32_t base = now + 1;
+            auto earliest = std::min_element(armed.begin(), armed.end(), [&](const ReferenceTimer &a, const ReferenceTimer &b) {
+                return static_cast<int32_t>(a.expiry - base) < static_cast<int32_t>(b.expiry - base);
+            });
+            if (static_cast<int32_t>(nextExpiry - base) != static_cast<int32_t>(earliest->expiry - base)) {
+                return Fail(seed, step, "next expiry " + std::to_string(nextExpiry) + " instead of " + std::to_string(earliest->expiry));
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    // From 0, and from shortly before the tick count wraps so every run crosses it
+    const uint32_t STARTS[] = { 0, 0xFFFFFFFFu - (1u << 24) };
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        for (uint32_t start : STARTS) {
+            if (!RunFuzz(seed, start, 20000)) return 1;
+        }
+    }
+    std::cout << "Timer wheel: OK" << std::endl;
+    return 0;
+}
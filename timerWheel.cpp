@@ -0,0 +1,189 @@
+#include "timerWheel.h"
+#include <algorithm>
+#include <iterator>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+int LowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+}
+
+TimerWheel::TimerWheel(uint32_t now) : current(now) {
+    for (auto &level : heads) std::fill(std::begin(level), std::end(level), NONE);
+}
+
+TimerWheel::Handle TimerWheel::Schedule(uint32_t expiry, uint32_t payload) {
+    int32_t index;
+    if (freeList != NONE) {
+        index = freeList;
+        freeList = nodes[index].next;
+    } else {
+        index = static_cast<int32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    Node &node = nodes[index];
+    node.expiry = expiry;
+    node.payload = payload;
+    Insert(index);
+    activeCount++;
+    return (static_cast<Handle>(node.generation) << 32) | static_cast<uint32_t>(index + 1);
+}
+
+bool TimerWheel::Cancel(Handle handle) {
+    int64_t index = static_cast<int64_t>(handle & 0xFFFFFFFF) - 1;
+    if (index < 0 || index >= static_cast<int64_t>(nodes.size())) return false;
+    Node &node = nodes[index];
+    if (node.level < 0 || node.generation != static_cast<uint32_t>(handle >> 32)) return false;
+
+    Unlink(static_cast<int32_t>(index));
+    Release(static_cast<int32_t>(index));
+    return true;
+}
+
+void TimerWheel::CancelAll() {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].level >= 0) Release(static_cast<int32_t>(i));
+    }
+    for (auto &level : heads) std::fill(std::begin(level), std::end(level), NONE);
+    std::fill(std::begin(occupied), std::end(occupied), 0);
+}
+
+void TimerWheel::Advance(uint32_t now, std::vector<uint32_t> &expired) {
+    while (static_cast<int32_t>(now - current) > 0) {
+        uint32_t time = current + 1; // Next tick to process
+        int slot = static_cast<int>(time & SLOT_MASK);
+
+        // Level 0 wrapped, pull the timers of the next stretch down from the coarser levels
+        if (slot == 0) Cascade(time);
+
+        // Jump straight to the first occupied slot up to now or the end of this rotation
+        uint32_t last = static_cast<int32_t>(now - (time | SLOT_MASK)) < 0 ? now : (time | SLOT_MASK);
+        int span = static_cast<int>(last - time);
+        uint64_t window = occupied[0] >> slot;
+        if (span < SLOTS - 1) window &= (uint64_t(2) << span) - 1;
+        if (!window) {
+            current = last;
+            continue;
+        }
+
+        int due = slot + LowestBit(window);
+        current = (time & ~SLOT_MASK) | static_cast<uint32_t>(due);
+        Expire(due, expired);
+    }
+}
+
+bool TimerWheel::GetNextExpiry(uint32_t &expiry) const {
+    uint32_t base = current + 1;
+    bool found = false;
+    for (int level = 0; level < LEVELS; level++) {
+        if (!occupied[level]) continue;
+
+        // Slots in time order start at base's slot. Above level 0 that slot holds the next rotation,
+        // unless base sits exactly where it's about to be cascaded.
+        int start = static_cast<int>((base >> (SLOT_BITS * level)) & SLOT_MASK);
+        uint32_t below = (uint32_t(1) << (SLOT_BITS * level)) - 1;
+        if (level > 0 && (base & below) != 0) start = (start + 1) & SLOT_MASK;
+        uint64_t rotated = start ? (occupied[level] >> start) | (occupied[level] << (SLOTS - start)) : occupied[level];
+
+        // The top level also holds timers parked beyond its range, which aren't in slot order, so check all of it
+        uint64_t slots = level == LEVELS - 1 ? rotated : rotated & (~rotated + 1);
+        for (; slots; slots &= slots - 1) {
+            int slot = (start + LowestBit(slots)) & SLOT_MASK;
+            for (int32_t index = heads[level][slot]; index != NONE; index = nodes[index].next) {
+                uint32_t candidate = nodes[index].expiry;
+                if (!found || static_cast<int32_t>(candidate - base) < static_cast<int32_t>(expiry - base)) expiry = candidate;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+void TimerWheel::Insert(int32_t index) {
+    Node &node = nodes[index];
+
+    // Relative to the next tick Advance processes; overdue timers go into that one
+    uint32_t base = current + 1;
+    const int32_t MAX_DELTA = (1 << (SLOT_BITS * LEVELS)) - 1;
+    int32_t delta = static_cast<int32_t>(node.expiry - base);
+    uint32_t target = node.expiry;
+    if (delta < 0) {
+        target = base;
+        delta = 0;
+    } else if (delta > MAX_DELTA) {
+        // Beyond the top level: park it as far out as possible, it's re-filed when it cascades
+        target = base + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1 << (SLOT_BITS * (level + 1)))) level++;
+    int slot = static_cast<int>((target >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    node.level = static_cast<int16_t>(level);
+    node.slot = static_cast<int16_t>(slot);
+    node.prev = NONE;
+    node.next = heads[level][slot];
+    if (node.next != NONE) nodes[node.next].prev = index;
+    heads[level][slot] = index;
+    occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::Unlink(int32_t index) {
+    Node &node = nodes[index];
+    if (node.prev != NONE) nodes[node.prev].next = node.next;
+    else heads[node.level][node.slot] = node.next;
+    if (node.next != NONE) nodes[node.next].prev = node.prev;
+    if (heads[node.level][node.slot] == NONE) occupied[node.level] &= ~(uint64_t(1) << node.slot);
+}
+
+void TimerWheel::Release(int32_t index) {
+    Node &node = nodes[index];
+    node.generation++;
+    node.level = -1;
+    node.prev = NONE;
+    node.next = freeList;
+    freeList = index;
+    activeCount--;
+}
+
+void TimerWheel::Cascade(uint32_t time) {
+    // Called with current == time - 1, so re-filed timers land relative to time
+    for (int level = 1; level < LEVELS; level++) {
+        int slot = static_cast<int>((time >> (SLOT_BITS * level)) & SLOT_MASK);
+        int32_t index = heads[level][slot];
+        heads[level][slot] = NONE;
+        occupied[level] &= ~(uint64_t(1) << slot);
+        while (index != NONE) {
+            int32_t next = nodes[index].next;
+            Insert(index);
+            index = next;
+        }
+        // Only carries on up when this level wrapped too
+        if (slot != 0) break;
+    }
+}
+
+void TimerWheel::Expire(int slot, std::vector<uint32_t> &expired) {
+    int32_t index = heads[0][slot];
+    heads[0][slot] = NONE;
+    occupied[0] &= ~(uint64_t(1) << slot);
+    while (index != NONE) {
+        int32_t next = nodes[index].next;
+        expired.push_back(nodes[index].payload);
+        Release(index);
+        index = next;
+    }
+}
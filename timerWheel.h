@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Hierarchical timing wheel over millisecond tick counts (wrapping, like Clock::NowMs).
+// Four levels of 64 slots, each level 64 times coarser than the one below; a timer sits in
+// the level matching how far away it is and drops down a level whenever the level below wraps.
+// Arming, cancelling and expiring are O(1), and advancing skips empty slots with a bitmap, so the
+// cost of a tick doesn't depend on how many timers are armed.
+// Timers live in a pooled free list, nothing is allocated once the pool has grown to its peak.
+class TimerWheel
+{
+public:
+    // 0 is never a valid handle; stale handles (already fired or cancelled) are ignored
+    using Handle = uint64_t;
+    static const Handle INVALID_HANDLE = 0;
+
+    explicit TimerWheel(uint32_t now = 0);
+
+    // Arms a timer that expires at tick count `expiry`; payload is handed back when it does
+    Handle Schedule(uint32_t expiry, uint32_t payload);
+    bool Cancel(Handle handle);
+    void CancelAll();
+
+    // Moves time forward to now, appending the payload of every timer that expired on the way
+    // to expired (in expiry order). expired isn't cleared, reuse it to avoid allocations.
+    void Advance(uint32_t now, std::vector<uint32_t> &expired);
+
+    // Earliest expiry of the armed timers, false if none are
+    bool GetNextExpiry(uint32_t &expiry) const;
+    int GetActiveCount() const { return activeCount; }
+    uint32_t GetTime() const { return current; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const int32_t NONE = -1;
+
+    struct Node
+    {
+        uint32_t expiry = 0;
+        uint32_t payload = 0;
+        uint32_t generation = 1; // Bumped on release, so old handles stop matching
+        int32_t prev = NONE, next = NONE;
+        int16_t level = -1;      // -1 while free
+        int16_t slot = 0;
+    };
+
+    std::vector<Node> nodes;
+    int32_t freeList = NONE;
+    int32_t heads[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS] = {}; // Bit s set if heads[level][s] isn't empty
+    uint32_t current;               // Every timer due at or before this has fired
+    int activeCount = 0;
+
+    void Insert(int32_t index);
+    void Unlink(int32_t index);
+    void Release(int32_t index);
+    void Cascade(uint32_t time);
+    void Expire(int slot, std::vector<uint32_t> &expired);
+};